@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "batch.h"
+#include "mixant.h"
+#include "transition.h"
+
+BatchScorer::BatchScorer()
+{
+}
+
+void BatchScorer::Build(Tracks const& tracks)
+{
+  semitones.resize(tracks.size());
+  keys.resize(tracks.size());
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    semitones[i] = tracks[i].log_bpm;
+    keys[i] = static_cast<unsigned char>(Key::GetKeyIndex(tracks[i].key));
+  }
+}
+
+void BatchScorer::Score(
+  std::vector<int> const& indices,
+  std::vector<size_t> const& offsets,
+  Sink const& sink,
+  size_t threads
+  ) const
+{
+  size_t num_mixes = offsets.empty() ? 0 : offsets.size() - 1;
+  size_t num_batches = (num_mixes + kBatchSize - 1) / kBatchSize;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, num_batches);
+
+  // Threads take whole batches until there are none left
+  std::atomic<size_t> next_batch(0);
+  std::mutex sink_mutex;
+  auto work = [&]()
+  {
+    std::vector<unsigned int> seen(semitones.size());
+    unsigned int stamp = 0;
+    ScoreBatch batch;
+    for (size_t b = next_batch++; b < num_batches; b = next_batch++) {
+      size_t beg = b * kBatchSize;
+      ScoreRange(indices, offsets, beg, std::min(beg + kBatchSize, num_mixes), seen, stamp, batch);
+      std::lock_guard<std::mutex> lock(sink_mutex);
+      sink(batch);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) {
+    workers.push_back(std::thread(work));
+  }
+  work();
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+void BatchScorer::ScoreRange(
+  std::vector<int> const& indices,
+  std::vector<size_t> const& offsets,
+  size_t beg,
+  size_t end,
+  std::vector<unsigned int>& seen,
+  unsigned int& stamp,
+  ScoreBatch& batch
+  ) const
+{
+  Transition const* transitions = TransitionTable::GetRow(0);
+  size_t num_keys = Key::GetKeys().size();
+  int num_tracks = static_cast<int>(semitones.size());
+
+  size_t base = offsets[beg];
+  size_t num_steps = offsets[end] - base;
+  batch.first = beg;
+  batch.step_base = base;
+  batch.mixes.resize(end - beg);
+  batch.edge_costs.assign(num_steps, 0);
+  batch.play_keys.assign(num_steps, 0);
+  batch.tunings.assign(num_steps, 0);
+
+  int const* order = indices.data();
+  double* costs = batch.edge_costs.data() - base;
+  unsigned char* plays = batch.play_keys.data() - base;
+  signed char* tuned = batch.tunings.data() - base;
+
+  for (size_t m = beg; m < end; ++m) {
+    MixScore& score = batch.mixes[m - beg];
+    score.error = kScoreOK;
+    score.total_cost = 0;
+    score.max_cost = 0;
+    score.mean_cost = 0;
+
+    // Tracks seen in this ordering are marked with this ordering's stamp
+    if (++stamp == 0) {
+      std::fill(seen.begin(), seen.end(), 0);
+      stamp = 1;
+    }
+
+    size_t first = offsets[m];
+    size_t last = offsets[m+1];
+    for (size_t s = first; s < last; ++s) {
+      int t = order[s];
+      if (t < 0 || t >= num_tracks) {
+        score.error = kScoreBadTrack;
+        break;
+      }
+      if (seen[t] == stamp) {
+        score.error = kScoreRepeatedTrack;
+        break;
+      }
+      seen[t] = stamp;
+    }
+    if (score.error != kScoreOK || first == last) {
+      continue;
+    }
+
+    // The first track plays in its own key
+    int prv = order[first];
+    unsigned char prv_play = keys[prv];
+    plays[first] = prv_play;
+    for (size_t s = first + 1; s < last; ++s) {
+      int cur = order[s];
+      unsigned char natural = keys[cur];
+      Transition const& t = transitions[prv_play * num_keys + natural];
+      double cost = MixAnt::FindTransitionCost(semitones[prv] - semitones[cur], t.transpose);
+
+      unsigned char play = t.play_key;
+      costs[s] = cost;
+      plays[s] = play;
+      tuned[s] = t.tuning;
+
+      score.total_cost += cost;
+      score.max_cost = std::max(score.max_cost, cost);
+      prv = cur;
+      prv_play = play;
+    }
+    if (last - first > 1) {
+      score.mean_cost = score.total_cost / (last - first - 1);
+    }
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <functional>
+#include <vector>
+
+#include "track.h"
+
+enum ScoreError
+{
+  kScoreOK,
+  kScoreBadTrack,
+  kScoreRepeatedTrack
+};
+
+struct MixScore
+{
+  ScoreError error;
+  double     total_cost;
+  double     max_cost;
+  double     mean_cost;
+};
+
+// Scores for a run of consecutive orderings, starting at first
+// Per-step results line up with the input indices: ordering i's steps are at
+// offsets[i] - step_base up to offsets[i+1] - step_base
+// As with Mix::GetEdgeCosts, each step holds the cost of the transition into
+// it, so the first step of an ordering always costs zero
+struct ScoreBatch
+{
+  size_t                      first;
+  size_t                      step_base;
+  std::vector<MixScore>       mixes;
+  std::vector<double>         edge_costs;
+  std::vector<unsigned char>  play_keys;
+  std::vector<signed char>    tunings;
+};
+
+// Scores many orderings of one set of tracks at once
+// Orderings come in as one flat array of track indices, with ordering i
+// taking up indices[offsets[i]] up to indices[offsets[i+1]]
+// Each track's tempo (in semitones) and key are packed into flat arrays, and
+// play keys, tunings and transpositions come from the TransitionTable, so
+// scoring a transition is a handful of gathers and no key searches
+// Results give the same costs, play keys and tunings as building each Mix a
+// step at a time (choosing play keys with MixAnt::ChoosePlayKey)
+class BatchScorer
+{
+public:
+
+  // Orderings handed to each call of the sink
+  static const size_t kBatchSize = 4096;
+
+  typedef std::function<void(ScoreBatch const&)> Sink;
+
+  BatchScorer();
+
+  void Build(Tracks const& tracks);
+
+  // Splits the orderings over threads (zero means one per hardware thread)
+  // Batches go to the sink as soon as they're done, one at a time but not
+  // necessarily in order
+  void Score(
+    std::vector<int> const& indices,
+    std::vector<size_t> const& offsets,
+    Sink const& sink,
+    size_t threads = 0
+    ) const;
+
+protected:
+
+  void ScoreRange(
+    std::vector<int> const& indices,
+    std::vector<size_t> const& offsets,
+    size_t beg,
+    size_t end,
+    std::vector<unsigned int>& seen,
+    unsigned int& stamp,
+    ScoreBatch& batch
+    ) const;
+
+  std::vector<double>        semitones;
+  std::vector<unsigned char> keys;
+};
+
+#endif
@@ -0,0 +1,615 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "bitsearch.h"
+#include "compact.h"
+#include "components.h"
+#include "graph.h"
+#include "horizon.h"
+#include "library.h"
+#include "mixant.h"
+#include "neighbors.h"
+#include "search.h"
+#include "synth.h"
+#include "trace.h"
+
+using namespace std;
+
+// Benchmarks for the hot spots, run on synthetic crates
+//
+// Usage: mixant_bench [--max-n N] [--min-time S] [--seed S] [--out results.json]
+//                     [--compare baseline.json] [--tolerance T] [--traces K]
+//
+// Every result is lower-is-better: nanoseconds per operation for the
+// microbenchmarks, and seconds each solver takes to reach a target quality
+// (a mix nearly as long as a reference solve finds) for the solvers
+// With --compare, anything slower than the baseline by more than the
+// tolerance is flagged and the exit code is non-zero
+// With --traces, FindMix is also run from K different solver seeds on each
+// crate, and the spread of their convergence traces is written to
+// trace_FindMix_<n>.csv (see mixant_trace_report to aggregate your own)
+
+struct BenchResult
+{
+  string name;
+  size_t n;
+  string unit;
+  double value;
+  double quality;
+};
+
+typedef vector<BenchResult> BenchResults;
+
+// Keeps the optimizer from throwing away the work we're timing
+static volatile double sink;
+
+static const size_t kCrateSizes[] = { 20, 100, 1000, 10000, 100000 };
+
+// FindTrackDistances is quadratic in memory as well as time
+static const size_t kMaxMatrixSize = 2000;
+
+// Compatible pairs still grow quadratically with crate size
+static const size_t kMaxGraphSize = 10000;
+
+// Solvers are only asked to get this close to a reference solve
+static const double kTargetFraction = 0.9;
+
+static double Now()
+{
+  using namespace std::chrono;
+  return duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs f (which does ops operations per call) in growing batches until we've
+// spent at least min_time, then returns the time per operation in nanoseconds
+template <typename F>
+static double TimePerOp(F f, size_t ops, double min_time)
+{
+  size_t calls = 1;
+  for (;;) {
+    double beg = Now();
+    for (size_t i = 0; i < calls; ++i) {
+      f();
+    }
+    double elapsed = Now() - beg;
+    if (elapsed >= min_time) {
+      return elapsed * 1e9 / (calls * ops);
+    }
+    calls *= 2;
+  }
+}
+
+static void Report(BenchResults& results, string const& name, size_t n, string const& unit, double value, double quality = 0)
+{
+  BenchResult r = { name, n, unit, value, quality };
+  results.push_back(r);
+  cout << left << setw(28) << name << right << setw(8) << n << setw(16) << value << " " << unit;
+  if (quality) {
+    cout << " (quality " << quality << ")";
+  }
+  cout << endl;
+}
+
+static void BenchKeys(BenchResults& results, double min_time)
+{
+  Keys const& keys = Key::GetKeys();
+
+  Report(results, "Key::GetCompatibleKeys", keys.size(), "ns/op", TimePerOp([&]() {
+    Keys compatible;
+    for (auto const& k : keys) {
+      Key::GetCompatibleKeys(k, compatible);
+      sink = compatible[3].num;
+    }
+  }, keys.size(), min_time));
+
+  Report(results, "Key::AreCompatibleKeys", keys.size() * keys.size(), "ns/op", TimePerOp([&]() {
+    int count = 0;
+    for (auto const& a : keys) {
+      for (auto const& b : keys) {
+        count += Key::AreCompatibleKeys(a, b);
+      }
+    }
+    sink = count;
+  }, keys.size() * keys.size(), min_time));
+
+  Report(results, "Key::GetTransposeDistance", keys.size() * keys.size() / 2, "ns/op", TimePerOp([&]() {
+    int total = 0;
+    for (auto const& a : keys) {
+      for (auto const& b : keys) {
+        if (a.type == b.type) {
+          total += Key::GetTransposeDistance(a, b);
+        }
+      }
+    }
+    sink = total;
+  }, keys.size() * keys.size() / 2, min_time));
+
+  Report(results, "Key::operator+", keys.size() * 12, "ns/op", TimePerOp([&]() {
+    int total = 0;
+    for (auto const& k : keys) {
+      for (int st = -6; st < 6; ++st) {
+        total += (k + st).num;
+      }
+    }
+    sink = total;
+  }, keys.size() * 12, min_time));
+
+  vector<string> names;
+  for (auto const& k : keys) {
+    names.push_back(Key::GetShortName(k.num, k.type));
+  }
+  Report(results, "Key::KeyFromString", names.size(), "ns/op", TimePerOp([&]() {
+    int total = 0;
+    for (auto const& n : names) {
+      total += Key::KeyFromString(n).num;
+    }
+    sink = total;
+  }, names.size(), min_time));
+}
+
+static void BenchDistances(BenchResults& results, size_t max_n, unsigned int seed, double min_time)
+{
+  Tracks tracks;
+  vector<string> names;
+  SyntheticCrate::Generate(1000, seed, tracks, names);
+
+  Report(results, "MixAnt::FindDistance", tracks.size(), "ns/op", TimePerOp([&]() {
+    double total = 0;
+    for (size_t i = 1; i < tracks.size(); ++i) {
+      total += MixAnt::FindDistance(tracks[i-1].bpm, tracks[i].bpm, tracks[i-1].key, tracks[i].key);
+    }
+    sink = total;
+  }, tracks.size() - 1, min_time));
+
+  for (auto n : kCrateSizes) {
+    if (n > max_n || n > kMaxMatrixSize) {
+      break;
+    }
+    SyntheticCrate::Generate(n, seed, tracks, names);
+    Report(results, "MixAnt::FindTrackDistances", n, "ns/pair", TimePerOp([&]() {
+      Matrix dists = MixAnt::FindTrackDistances(tracks);
+      sink = dists.back().front();
+    }, n * n, min_time));
+  }
+
+  // The graph only holds compatible pairs, so it goes further
+  for (auto n : kCrateSizes) {
+    if (n > max_n || n > kMaxGraphSize) {
+      break;
+    }
+    SyntheticCrate::Generate(n, seed, tracks, names);
+    Report(results, "CompatibilityGraph::Build", n, "ns/track", TimePerOp([&]() {
+      CompatibilityGraph graph;
+      graph.Build(tracks, kRuleDistance);
+      sink = static_cast<double>(graph.GetNumEdges());
+    }, n, min_time));
+  }
+}
+
+static void BenchParsing(BenchResults& results, size_t max_n, unsigned int seed, double min_time)
+{
+  string const path = "bench_tracks.tsv";
+  for (auto n : kCrateSizes) {
+    if (n > max_n) {
+      break;
+    }
+
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+    Library::WriteTabSeparated(path, tracks, names);
+
+    Report(results, "Library::ReadTabSeparated", n, "ns/track", TimePerOp([&]() {
+      Library::ReadTabSeparated(path, tracks, names);
+      sink = tracks.back().bpm;
+    }, n, min_time));
+  }
+  remove(path.c_str());
+}
+
+// Latency of single next-track queries, reported as the 99th percentile
+// since that's what a DJ waiting on a suggestion notices
+static void BenchSuggest(BenchResults& results, size_t max_n, unsigned int seed)
+{
+  static const int kQueries = 10000;
+  static const size_t kPlayed = 50;
+  static const size_t kCount = 10;
+
+  std::mt19937 eng(seed);
+  for (auto n : kCrateSizes) {
+    if (n > max_n) {
+      break;
+    }
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    NeighborIndex index;
+    index.Build(tracks);
+
+    std::uniform_int_distribution<int> rnd_track(0, static_cast<int>(n) - 1);
+    vector<bool> played(n);
+    for (size_t i = 0; i < kPlayed; ++i) {
+      played[rnd_track(eng)] = true;
+    }
+
+    vector<double> latencies(kQueries);
+    Suggestions suggestions;
+    for (int q = 0; q < kQueries; ++q) {
+      int playing = rnd_track(eng);
+      Key play_key = MixAnt::ChoosePlayKey(tracks[rnd_track(eng)].key, tracks[playing].key);
+      double beg = Now();
+      index.Query(playing, play_key, played, kCount, suggestions, kDistThreshold);
+      latencies[q] = Now() - beg;
+      sink = suggestions.empty() ? 0 : suggestions[0].cost;
+    }
+    sort(latencies.begin(), latencies.end());
+    Report(results, "NeighborIndex::Query", n, "us", latencies[kQueries * 99 / 100] * 1e6);
+  }
+}
+
+// Bulk scoring of random orderings on one thread
+static void BenchBatchScoring(BenchResults& results, size_t max_n, unsigned int seed, double min_time)
+{
+  static const size_t kBatchTracks = 1000;
+  static const size_t kOrderings = 100000;
+  static const size_t kOrderingLen = 20;
+
+  size_t n = min(kBatchTracks, max_n);
+  Tracks tracks;
+  vector<string> names;
+  SyntheticCrate::Generate(n, seed, tracks, names);
+
+  BatchScorer scorer;
+  scorer.Build(tracks);
+
+  std::mt19937 eng(seed);
+  vector<int> pool(n);
+  for (size_t i = 0; i < n; ++i) {
+    pool[i] = static_cast<int>(i);
+  }
+  size_t len = min(kOrderingLen, n);
+  vector<int> indices;
+  vector<size_t> offsets(1, 0);
+  for (size_t o = 0; o < kOrderings; ++o) {
+    for (size_t i = 0; i < len; ++i) {
+      swap(pool[i], pool[i + eng() % (n - i)]);
+      indices.push_back(pool[i]);
+    }
+    offsets.push_back(indices.size());
+  }
+
+  Report(results, "BatchScorer::Score", n, "ns/mix", TimePerOp([&]() {
+    double total = 0;
+    scorer.Score(indices, offsets, [&](ScoreBatch const& batch) {
+      total += batch.mixes.back().total_cost;
+    }, 1);
+    sink = total;
+  }, kOrderings, min_time));
+}
+
+// Seconds from the start of trace until it first reached a mix of target
+// tracks, with the length it reached in quality
+// A trace that never got there gives its last point instead, which shows up
+// as a quality below the target
+static double TimeToTarget(ConvergenceTrace const& trace, size_t target, double& quality)
+{
+  TracePoints const& points = trace.GetPoints();
+  if (points.empty()) {
+    quality = 0;
+    return 0;
+  }
+  for (auto const& p : points) {
+    if (p.length >= target) {
+      quality = p.length;
+      return p.time;
+    }
+  }
+  quality = points.back().length;
+  return points.back().time;
+}
+
+// Time to a target quality: first see how long a mix a reference solve finds,
+// then trace a fresh solve (setup included) and report how long it took to
+// get close to that, however long it then carries on for
+static void BenchSolvers(BenchResults& results, size_t max_n, unsigned int seed)
+{
+  static const size_t kMixSizes[] = { 20, 100, 500, 1000, 2000 };
+  static const int kReferenceRuns = 10;
+
+  double quality;
+  for (auto n : kMixSizes) {
+    if (n > max_n) {
+      break;
+    }
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    MixAnt reference;
+    reference.Seed(seed);
+    size_t target = static_cast<size_t>(ceil(kTargetFraction * reference.FindMix(tracks, nullptr, kReferenceRuns).steps.size()));
+
+    ConvergenceTrace trace;
+    MixAnt ma;
+    ma.Seed(seed + 1);
+    ma.SetTrace(&trace);
+    trace.Start();
+    ma.FindMix(tracks, nullptr, kReferenceRuns, target);
+    double time = TimeToTarget(trace, target, quality);
+    Report(results, "MixAnt::FindMix", n, "s", time, quality);
+  }
+
+  // The exhaustive searches are capped at kMixSongLen tracks, so the
+  // reference is the first mix the bitset search finds at that cap, from
+  // whichever start gets there
+  static const size_t kTrackSizes[] = { 20, 50, 100, 200, 500 };
+
+  for (auto n : kTrackSizes) {
+    if (n > max_n) {
+      break;
+    }
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    CompatibilityGraph graph;
+    graph.Build(tracks, kRuleKeyShift);
+    BitsetSearch bitsets;
+    bitsets.Build(graph);
+    size_t cap = kMixSongLen - 1;
+    CompactMix best;
+    for (size_t i = 0; i < tracks.size() && best.size() < cap; ++i) {
+      double best_cost = DBL_MAX;
+      bitsets.Search(tracks, graph.GetStartNode(static_cast<int>(i)), kMixSongLen, cap, best, best_cost);
+    }
+    size_t target = static_cast<size_t>(ceil(kTargetFraction * best.size()));
+
+    ConvergenceTrace trace;
+    trace.Start();
+    graph.Build(tracks, kRuleKeyShift);
+    best.Clear();
+    std::vector<bool> used(tracks.size());
+    for (size_t i = 0; i < tracks.size() && best.size() < target; ++i) {
+      Track const& t = tracks[i];
+      used[i] = true;
+
+      CompactMix chosen;
+      chosen.Push(t.idx, t.key, t.bpm, t.bpm);
+      double best_cost = DBL_MAX;
+      int its = 0;
+      ChooseTrack(names, tracks, graph, used, chosen, graph.GetStartNode(static_cast<int>(i)), 0, best_cost, kMixSongLen, target, best, its, &trace);
+      used[i] = false;
+    }
+    double time = TimeToTarget(trace, target, quality);
+    Report(results, "ChooseTrack", n, "s", time, quality);
+
+    ConvergenceTrace bitset_trace;
+    bitset_trace.Start();
+    graph.Build(tracks, kRuleKeyShift);
+    bitsets.Build(graph);
+    best.Clear();
+    for (size_t i = 0; i < tracks.size() && best.size() < target; ++i) {
+      double best_cost = DBL_MAX;
+      bitsets.Search(tracks, graph.GetStartNode(static_cast<int>(i)), kMixSongLen, target, best, best_cost, &bitset_trace);
+    }
+    time = TimeToTarget(bitset_trace, target, quality);
+    Report(results, "BitsetSearch::Search", n, "s", time, quality);
+  }
+
+  // A whole long set from the tracks alone (the planner's graph, where to
+  // start, then window by window), which should take about twice as long for
+  // twice as many tracks
+  static const size_t kSetSizes[] = { 1000, 2000, 4000 };
+
+  for (auto n : kSetSizes) {
+    if (n > max_n) {
+      break;
+    }
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    double beg = Now();
+    HorizonPlanner planner;
+    planner.Build(tracks);
+    GraphComponents parts;
+    parts.Build(planner.GetGraph());
+    int start = HorizonPlanner::FindStart(tracks, planner.GetGraph(), parts);
+    Mix m = planner.Plan(tracks, start, kHorizonWindow, kHorizonCommit, SIZE_MAX);
+    Report(results, "HorizonPlanner", n, "s", Now() - beg, m.steps.size());
+  }
+
+  // Key orders are searched to the end anyway, so that one search is its own
+  // reference
+  static const size_t kKeySizes[] = { 6, 9 };
+
+  for (auto n : kKeySizes) {
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    KeyCount key_counts;
+    for (auto const& t : tracks) {
+      key_counts[t.key]++;
+    }
+
+    ConvergenceTrace trace;
+    trace.Start();
+    int max_depth = 0;
+    for (auto const& k : key_counts) {
+      ChooseKey(k.first, key_counts, Keys(), 1, max_depth, &trace);
+    }
+    size_t target = static_cast<size_t>(ceil(kTargetFraction * max_depth));
+    double time = TimeToTarget(trace, target, quality);
+    Report(results, "ChooseKey", n, "s", time, quality);
+  }
+}
+
+// Quality against time and evaluations over K solver seeds on the same crate
+static void BenchTraces(size_t max_n, unsigned int seed, int num_seeds)
+{
+  static const size_t kTraceSizes[] = { 100, 500 };
+  static const size_t kReportPoints = 50;
+
+  for (auto n : kTraceSizes) {
+    if (n > max_n) {
+      break;
+    }
+    Tracks tracks;
+    vector<string> names;
+    SyntheticCrate::Generate(n, seed, tracks, names);
+
+    vector<ConvergenceTrace> traces(num_seeds);
+    for (int s = 0; s < num_seeds; ++s) {
+      MixAnt ma;
+      ma.Seed(s + 1);
+      ma.SetTrace(&traces[s]);
+      traces[s].Start();
+      ma.FindMix(tracks);
+    }
+
+    stringstream path;
+    path << "trace_FindMix_" << n << ".csv";
+    TraceReport::Write(path.str(), traces, false, kReportPoints);
+    cout << "Wrote convergence of " << num_seeds << " seeds to " << path.str() << endl;
+  }
+}
+
+static void WriteResults(string const& path, BenchResults const& results)
+{
+  ofstream ofs(path);
+  ofs << "{" << endl << "  \"results\": [" << endl;
+  for (size_t i = 0; i < results.size(); ++i) {
+    BenchResult const& r = results[i];
+    ofs << "    { \"name\": \"" << r.name << "\", \"n\": " << r.n << ", \"unit\": \"" << r.unit
+        << "\", \"value\": " << r.value << ", \"quality\": " << r.quality << " }"
+        << (i + 1 < results.size() ? "," : "") << endl;
+  }
+  ofs << "  ]" << endl << "}" << endl;
+  ofs.close();
+}
+
+static string GetField(string const& line, string const& field)
+{
+  string tag = "\"" + field + "\": ";
+  size_t beg = line.find(tag);
+  if (beg == string::npos) {
+    return "";
+  }
+  beg += tag.size();
+  if (line[beg] == '"') {
+    ++beg;
+    return line.substr(beg, line.find('"', beg) - beg);
+  }
+  return line.substr(beg, line.find_first_of(",}", beg) - beg);
+}
+
+// Only needs to understand what WriteResults writes (one result per line)
+static BenchResults ReadResults(string const& path)
+{
+  BenchResults results;
+  ifstream ifs(path);
+  string line;
+  while (getline(ifs, line)) {
+    if (line.find("\"name\"") == string::npos) {
+      continue;
+    }
+    BenchResult r;
+    r.name = GetField(line, "name");
+    r.n = atoi(GetField(line, "n").c_str());
+    r.unit = GetField(line, "unit");
+    r.value = atof(GetField(line, "value").c_str());
+    r.quality = atof(GetField(line, "quality").c_str());
+    results.push_back(r);
+  }
+  return results;
+}
+
+// Returns the number of regressions
+static int Compare(BenchResults const& baseline, BenchResults const& results, double tolerance)
+{
+  int regressions = 0;
+  cout << endl << "Compared to baseline:" << endl;
+  for (auto const& r : results) {
+    for (auto const& b : baseline) {
+      if (b.name != r.name || b.n != r.n || b.value <= 0) {
+        continue;
+      }
+      double ratio = r.value / b.value;
+      char const* verdict = "";
+      if (ratio > 1 + tolerance) {
+        verdict = "REGRESSION";
+        ++regressions;
+      } else if (ratio < 1 - tolerance) {
+        verdict = "improved";
+      }
+      cout << left << setw(28) << r.name << right << setw(8) << r.n
+           << setw(12) << fixed << setprecision(2) << ratio << "x " << verdict << endl;
+      cout.unsetf(ios::fixed);
+      cout << setprecision(6);
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+  size_t max_n = 100000;
+  double min_time = 0.2;
+  unsigned int seed = 1;
+  double tolerance = 0.1;
+  string out_path = "bench.json";
+  string baseline_path;
+  int num_trace_seeds = 0;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string arg = argv[i];
+    if (arg == "--max-n") {
+      max_n = atoi(argv[i+1]);
+    } else if (arg == "--min-time") {
+      min_time = atof(argv[i+1]);
+    } else if (arg == "--seed") {
+      seed = atoi(argv[i+1]);
+    } else if (arg == "--out") {
+      out_path = argv[i+1];
+    } else if (arg == "--compare") {
+      baseline_path = argv[i+1];
+    } else if (arg == "--tolerance") {
+      tolerance = atof(argv[i+1]);
+    } else if (arg == "--traces") {
+      num_trace_seeds = atoi(argv[i+1]);
+    } else {
+      cerr << "Unknown option " << arg << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  BenchResults results;
+  BenchKeys(results, min_time);
+  BenchDistances(results, max_n, seed, min_time);
+  BenchParsing(results, max_n, seed, min_time);
+  BenchSuggest(results, max_n, seed);
+  BenchBatchScoring(results, max_n, seed, min_time);
+  BenchSolvers(results, max_n, seed);
+  if (num_trace_seeds > 0) {
+    BenchTraces(max_n, seed, num_trace_seeds);
+  }
+
+  WriteResults(out_path, results);
+  cout << "Wrote " << results.size() << " results to " << out_path << endl;
+
+  if (!baseline_path.empty()) {
+    return Compare(ReadResults(baseline_path), results, tolerance) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  return EXIT_SUCCESS;
+}
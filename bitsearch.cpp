@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cfloat>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "bitsearch.h"
+#include "logger.h"
+#include "metrics.h"
+
+static const int kWordBits = 64;
+
+// Iterations without improvement before a search gives up, as in ChooseTrack
+static const int kMaxStaleIterations = 1000000;
+
+// Nodes expanded between looks at the clock
+static const unsigned int kDeadlineTicks = 4096;
+
+static inline int PopCount(BitsetSearch::Word w)
+{
+#ifdef _MSC_VER
+  return static_cast<int>(__popcnt64(w));
+#else
+  return __builtin_popcountll(w);
+#endif
+}
+
+static inline int LowestBit(BitsetSearch::Word w)
+{
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, w);
+  return static_cast<int>(idx);
+#else
+  return __builtin_ctzll(w);
+#endif
+}
+
+BitsetSearch::BitsetSearch() :
+  graph(nullptr),
+  words(0),
+  front(nullptr),
+  alternatives(nullptr),
+  patience(kMaxStaleIterations),
+  max_cost(DBL_MAX),
+  progress_level(kLogInfo),
+  deadline(std::chrono::steady_clock::time_point::max()),
+  timed_out(false),
+  ticks(0),
+  tracks(nullptr),
+  max_len(0),
+  stop_len(0),
+  best(nullptr),
+  best_cost(nullptr),
+  trace(nullptr),
+  its(0)
+{
+}
+
+void BitsetSearch::Build(CompatibilityGraph const& graph)
+{
+  this->graph = &graph;
+  size_t num_tracks = graph.GetNumTracks();
+  size_t num_nodes = graph.GetNumNodes();
+  words = (num_tracks + kWordBits - 1) / kWordBits;
+
+  node_sets.assign(num_nodes * words, 0);
+  track_sets.assign(num_tracks * words, 0);
+  by_track.assign(graph.EdgesBegin(0), graph.EdgesEnd(static_cast<int>(num_nodes) - 1));
+
+  GraphEdge const* first = graph.EdgesBegin(0);
+  for (size_t n = 0; n < num_nodes; ++n) {
+    int node = static_cast<int>(n);
+    Word* node_set = &node_sets[n * words];
+    Word* track_set = &track_sets[graph.GetTrack(node) * words];
+    for (auto e = graph.EdgesBegin(node); e != graph.EdgesEnd(node); ++e) {
+      int t = graph.GetTrack(e->node);
+      node_set[t / kWordBits] |= Word(1) << (t % kWordBits);
+      track_set[t / kWordBits] |= Word(1) << (t % kWordBits);
+    }
+
+    // Each node has at most one edge to each track
+    std::sort(by_track.begin() + (graph.EdgesBegin(node) - first), by_track.begin() + (graph.EdgesEnd(node) - first), [&](GraphEdge const& a, GraphEdge const& b)
+    {
+      return a.node < b.node;
+    });
+  }
+
+  FindWords(node_sets, num_nodes, node_word_offsets, node_words);
+  FindWords(track_sets, num_tracks, track_word_offsets, track_words);
+  FillReachSets();
+}
+
+void BitsetSearch::FillReachSets()
+{
+  if (max_cost == DBL_MAX) {
+    reach_node_sets = node_sets;
+    reach_track_sets = track_sets;
+    return;
+  }
+
+  // Edges are cheapest first, so each node's run is cut short
+  reach_node_sets.assign(node_sets.size(), 0);
+  reach_track_sets.assign(track_sets.size(), 0);
+  for (size_t n = 0; n < graph->GetNumNodes(); ++n) {
+    int node = static_cast<int>(n);
+    Word* node_set = &reach_node_sets[n * words];
+    Word* track_set = &reach_track_sets[graph->GetTrack(node) * words];
+    for (auto e = graph->EdgesBegin(node); e != graph->EdgesEnd(node) && e->cost <= max_cost; ++e) {
+      int t = graph->GetTrack(e->node);
+      node_set[t / kWordBits] |= Word(1) << (t % kWordBits);
+      track_set[t / kWordBits] |= Word(1) << (t % kWordBits);
+    }
+  }
+}
+
+void BitsetSearch::FindWords(
+  std::vector<Word> const& sets,
+  size_t count,
+  std::vector<size_t>& offsets,
+  std::vector<unsigned int>& nonzero
+  ) const
+{
+  offsets.assign(1, 0);
+  nonzero.clear();
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t w = 0; w < words; ++w) {
+      if (sets[i * words + w]) {
+        nonzero.push_back(static_cast<unsigned int>(w));
+      }
+    }
+    offsets.push_back(nonzero.size());
+  }
+}
+
+void BitsetSearch::SetFront(ParetoArchive* front)
+{
+  this->front = front;
+}
+
+void BitsetSearch::SetAlternatives(DiverseMixes* alternatives)
+{
+  this->alternatives = alternatives;
+}
+
+void BitsetSearch::SetPatience(int iterations)
+{
+  patience = iterations;
+}
+
+void BitsetSearch::SetMaxCost(double max_cost)
+{
+  if (max_cost != this->max_cost) {
+    this->max_cost = max_cost;
+    if (graph) {
+      FillReachSets();
+    }
+  }
+}
+
+void BitsetSearch::SetProgressLevel(LogLevel level)
+{
+  progress_level = level;
+}
+
+void BitsetSearch::SetDeadline(std::chrono::steady_clock::time_point deadline)
+{
+  this->deadline = deadline;
+}
+
+bool BitsetSearch::TimedOut() const
+{
+  return timed_out;
+}
+
+void BitsetSearch::FillRemaining(size_t tracks, int except, std::vector<Word>& remaining)
+{
+  size_t words = (tracks + kWordBits - 1) / kWordBits;
+  remaining.assign(words, ~Word(0));
+  if (tracks % kWordBits) {
+    remaining.back() = (Word(1) << (tracks % kWordBits)) - 1;
+  }
+  Remove(except, remaining);
+}
+
+void BitsetSearch::Remove(int track, std::vector<Word>& remaining)
+{
+  remaining[track / kWordBits] &= ~(Word(1) << (track % kWordBits));
+}
+
+bool BitsetSearch::Has(int track, std::vector<Word> const& remaining)
+{
+  return (remaining[track / kWordBits] >> (track % kWordBits)) & 1;
+}
+
+void BitsetSearch::Search(
+  Tracks const& tracks,
+  int start_node,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  double& best_cost,
+  ConvergenceTrace* trace,
+  CostAggregate aggregate
+  )
+{
+  // Everything but the start remains
+  FillRemaining(tracks.size(), graph->GetTrack(start_node), remaining);
+  StartSearch(tracks, start_node, max_len, stop_len, best, best_cost, trace, aggregate);
+}
+
+void BitsetSearch::Search(
+  Tracks const& tracks,
+  std::vector<Word> const& remaining,
+  int start_node,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  double& best_cost,
+  ConvergenceTrace* trace,
+  CostAggregate aggregate
+  )
+{
+  this->remaining = remaining;
+  StartSearch(tracks, start_node, max_len, stop_len, best, best_cost, trace, aggregate);
+}
+
+void BitsetSearch::StartSearch(
+  Tracks const& tracks,
+  int start_node,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  double& best_cost,
+  ConvergenceTrace* trace,
+  CostAggregate aggregate
+  )
+{
+  typedef void (BitsetSearch::*Chooser)(int, double);
+
+  // Indexed by CostAggregate
+  static Chooser const kChoosers[] = {
+    &BitsetSearch::Choose<SumCost>,
+    &BitsetSearch::Choose<MaxCost>
+  };
+
+  this->tracks = &tracks;
+  this->max_len = max_len;
+  this->stop_len = stop_len;
+  this->best = &best;
+  this->best_cost = &best_cost;
+  this->trace = trace;
+  its = 0;
+  timed_out = false;
+
+  int start = graph->GetTrack(start_node);
+  reach.assign(words, 0);
+  frontier.assign(words, 0);
+  candidates.resize(std::max(max_len, 1), std::vector<Word>(words));
+  totals.assign(std::max(max_len, 1), 0);
+  worsts.assign(std::max(max_len, 1), 0);
+
+  chosen.Clear();
+  chosen.Push(tracks[start].idx, graph->GetKey(start_node), tracks[start].bpm, tracks[start].bpm);
+  (this->*kChoosers[aggregate])(start_node, 0);
+}
+
+template <typename Aggregate>
+void BitsetSearch::Choose(int node, double cost)
+{
+  METRIC_COUNT(kNodesExpanded, 1);
+
+  if (++ticks % kDeadlineTicks == 0 && std::chrono::steady_clock::now() > deadline) {
+    timed_out = true;
+  }
+
+  // We're too long, already good enough, or out of time!
+  if (chosen.size() >= static_cast<size_t>(max_len) || best->size() >= stop_len || timed_out) {
+    METRIC_COUNT(kNodesPruned, 1);
+    return;
+  }
+
+  if (front) {
+    size_t last = chosen.size() - 1;
+    front->Offer(chosen.size(), totals[last], worsts[last], chosen);
+  }
+  if (alternatives) {
+    alternatives->Offer(chosen.size(), cost, chosen);
+  }
+
+  // Longer beats cheaper, as in ChooseTrack
+  if (chosen.size() > best->size() || (chosen.size() == best->size() && cost < *best_cost)) {
+    bool longer = chosen.size() > best->size();
+    *best_cost = cost;
+    *best = chosen;
+    if (longer) {
+      LOG(progress_level) << "New best of length " << best->size() << " found.";
+    } else {
+      LOG(kLogDebug) << "New best cost of " << *best_cost << " found.";
+    }
+    METRIC_IMPROVEMENT(best->size(), *best_cost);
+    if (trace) {
+      trace->Record(best->size(), *best_cost);
+    }
+    its = 0;
+  } else {
+    ++its;
+  }
+
+  // We've spent too long, so bail!
+  if (patience > 0 && its >= patience) {
+    LOG(kLogDebug) << "Too many iterations without improvement!";
+    METRIC_COUNT(kNodesPruned, 1);
+    return;
+  }
+
+  // Adding transitions never makes a mix cheaper, so once we're no cheaper
+  // than the best the only way to beat it is to get longer
+  // Drop branches that can't reach enough tracks to do that, unless they
+  // could still make the front or the alternatives (which they can't if even
+  // a mix as long as they're allowed to get, at what they cost now, wouldn't)
+  size_t beat_len = best->size() + (cost >= *best_cost ? 1 : 0);
+  if (beat_len >= static_cast<size_t>(max_len) ||
+    (beat_len > chosen.size() && !CanReach(node, beat_len - chosen.size()))) {
+    size_t last = chosen.size() - 1;
+    if ((!front || !front->Accepts(max_len - 1, totals[last], worsts[last])) &&
+      (!alternatives || !alternatives->Accepts(max_len - 1, cost))) {
+      METRIC_COUNT(kNodesPruned, 1);
+      return;
+    }
+  }
+
+  METRIC_COUNT(kCandidatesScanned, graph->GetDegree(node));
+  if (trace) {
+    trace->Count(graph->GetDegree(node));
+  }
+
+  Word const* node_set = &node_sets[node * words];
+  unsigned int const* node_beg = node_words.data() + node_word_offsets[node];
+  unsigned int const* node_end = node_words.data() + node_word_offsets[node+1];
+  std::vector<Word>& cand = candidates[chosen.size()];
+  for (auto w = node_beg; w != node_end; ++w) {
+    cand[*w] = node_set[*w] & remaining[*w];
+  }
+
+  GraphEdge const* edges = by_track.data() + (graph->EdgesBegin(node) - graph->EdgesBegin(0));
+  size_t rank = 0;
+  for (auto wi = node_beg; wi != node_end; ++wi) {
+    size_t w = *wi;
+    for (Word bits = cand[w]; bits; bits &= bits - 1) {
+      int b = LowestBit(bits);
+      GraphEdge const& e = edges[rank + PopCount(node_set[w] & ((Word(1) << b) - 1))];
+      if (e.cost > max_cost) {
+        continue;
+      }
+      int t = static_cast<int>(w) * kWordBits + b;
+      Track const& track = (*tracks)[t];
+      METRIC_COUNT(kCandidatesUsable, 1);
+
+      // NOTE: The node carries an ADJUSTED key for this track!
+      remaining[w] &= ~(Word(1) << b);
+      chosen.Push(track.idx, graph->GetKey(e.node), track.bpm, track.bpm);
+      if (front) {
+        size_t last = chosen.size() - 1;
+        totals[last] = totals[last-1] + e.cost;
+        worsts[last] = std::max(worsts[last-1], e.cost);
+      }
+
+      Choose<Aggregate>(e.node, Aggregate::Add(cost, e.cost));
+
+      chosen.Pop();
+      remaining[w] |= Word(1) << b;
+    }
+    rank += PopCount(node_set[w]);
+  }
+}
+
+bool BitsetSearch::CanReach(int node, size_t need)
+{
+  // Start from the node's own neighbours, then spread a track at a time,
+  // stopping as soon as we've found enough
+  // Only words some neighbour set has bits in are looked at (and then
+  // cleared again), so a sparse graph doesn't pay for every track each time
+  Word const* node_set = &reach_node_sets[node * words];
+  size_t found = 0;
+  touched.clear();
+  for (size_t i = node_word_offsets[node]; i < node_word_offsets[node+1]; ++i) {
+    size_t w = node_words[i];
+    reach[w] = frontier[w] = node_set[w] & remaining[w];
+    if (reach[w]) {
+      touched.push_back(w);
+      found += PopCount(reach[w]);
+    }
+  }
+
+  // Spread from whichever word last picked up new tracks
+  pending.assign(touched.begin(), touched.end());
+  while (!pending.empty() && found < need) {
+    size_t w = pending.back();
+    if (!frontier[w]) {
+      pending.pop_back();
+      continue;
+    }
+    int b = LowestBit(frontier[w]);
+    frontier[w] &= frontier[w] - 1;
+    size_t t = w * kWordBits + b;
+    Word const* track_set = &reach_track_sets[t * words];
+    for (size_t j = track_word_offsets[t]; j < track_word_offsets[t+1]; ++j) {
+      size_t v = track_words[j];
+      Word added = track_set[v] & remaining[v] & ~reach[v];
+      if (added) {
+        if (!reach[v]) {
+          touched.push_back(v);
+        }
+        if (!frontier[v]) {
+          pending.push_back(v);
+        }
+        reach[v] |= added;
+        frontier[v] |= added;
+        found += PopCount(added);
+      }
+    }
+  }
+
+  for (auto w : touched) {
+    reach[w] = frontier[w] = 0;
+  }
+  return found >= need;
+}
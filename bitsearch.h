@@ -0,0 +1,186 @@
+#ifndef BITSEARCH_H
+#define BITSEARCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compact.h"
+#include "costs.h"
+#include "diverse.h"
+#include "graph.h"
+#include "logger.h"
+#include "pareto.h"
+#include "trace.h"
+#include "track.h"
+
+// Above this many tracks the bitsets take more memory than they save time
+static const size_t kMaxBitsetTracks = 8192;
+
+// The same exhaustive search as ChooseTrack, with its state held as bitsets
+// (one bit per track): the tracks still remaining, and for each graph node
+// the tracks it has an edge to. A node's candidates are then one AND per
+// 64 tracks, and a dead end shows up before any edges are scanned
+// Before branching, the tracks still reachable from a node (over any of each
+// track's keys) are gathered a neighbour set at a time, and a branch that
+// can't reach enough of them to beat the best (longer, or as long and
+// cheaper) is dropped
+// Candidates come in track order, as the original scan over available did
+// Mix costs add up edge costs as the aggregate says
+// Holds the state of one search at a time
+class BitsetSearch
+{
+public:
+
+  typedef uint64_t Word;
+
+  BitsetSearch();
+
+  // graph (a kRuleKeyShift graph) must outlive any searches
+  void Build(CompatibilityGraph const& graph);
+
+  // Offer every mix the search visits to front (pass nullptr to stop), by
+  // its total and worst edge costs
+  void SetFront(ParetoArchive* front);
+
+  // Offer every mix the search visits to alternatives (pass nullptr to stop)
+  void SetAlternatives(DiverseMixes* alternatives);
+
+  // Iterations without improvement before a search settles for its best
+  // (0 for no limit, so the search is exact)
+  void SetPatience(int iterations);
+
+  // Only follow edges costing no more than max_cost (DBL_MAX, the default,
+  // for all of them), so a search over a cheaper graph doesn't need its own
+  // bitsets
+  void SetMaxCost(double max_cost);
+
+  // Level new best lengths are logged at (kLogInfo by default), so callers
+  // running many small searches can keep them out of the way
+  void SetProgressLevel(LogLevel level);
+
+  // Searches give up at deadline with their best so far, and TimedOut says
+  // whether the last one did
+  void SetDeadline(std::chrono::steady_clock::time_point deadline);
+  bool TimedOut() const;
+
+  // Longest (then cheapest) mix starting from start_node, as ChooseTrack
+  // best and best_cost are the incumbent, shared with any earlier searches
+  void Search(
+    Tracks const& tracks,
+    int start_node,
+    int max_len,
+    size_t stop_len,
+    CompactMix& best,
+    double& best_cost,
+    ConvergenceTrace* trace = nullptr,
+    CostAggregate aggregate = kAggregateSum
+    );
+
+  // As above, but only over the tracks set in remaining (one bit per track,
+  // with the start's own track already cleared), so a caller can carry on
+  // from a mix it's already partly built
+  void Search(
+    Tracks const& tracks,
+    std::vector<Word> const& remaining,
+    int start_node,
+    int max_len,
+    size_t stop_len,
+    CompactMix& best,
+    double& best_cost,
+    ConvergenceTrace* trace = nullptr,
+    CostAggregate aggregate = kAggregateSum
+    );
+
+  // Bits for every track in tracks but one, for taking another out, and for
+  // checking one's still there
+  static void FillRemaining(size_t tracks, int except, std::vector<Word>& remaining);
+  static void Remove(int track, std::vector<Word>& remaining);
+  static bool Has(int track, std::vector<Word> const& remaining);
+
+protected:
+
+  // Searches from start_node over whatever remaining holds
+  void StartSearch(
+    Tracks const& tracks,
+    int start_node,
+    int max_len,
+    size_t stop_len,
+    CompactMix& best,
+    double& best_cost,
+    ConvergenceTrace* trace,
+    CostAggregate aggregate
+    );
+
+  template <typename Aggregate>
+  void Choose(int node, double cost);
+
+  // Can at least need remaining tracks be reached from node?
+  bool CanReach(int node, size_t need);
+
+  // Fills the reach sets from the edges no dearer than max_cost
+  void FillReachSets();
+
+  // Which words of each of count sets have any bits, CSR style
+  void FindWords(
+    std::vector<Word> const& sets,
+    size_t count,
+    std::vector<size_t>& offsets,
+    std::vector<unsigned int>& nonzero
+    ) const;
+
+  CompatibilityGraph const* graph;
+  size_t                    words;
+  ParetoArchive*            front;
+  DiverseMixes*             alternatives;
+  int                       patience;
+  double                    max_cost;
+  LogLevel                  progress_level;
+
+  std::chrono::steady_clock::time_point deadline;
+  bool                                  timed_out;
+  unsigned int                          ticks;
+
+  // Neighbour sets for each node, and for each track (over all its nodes)
+  std::vector<Word> node_sets;
+  std::vector<Word> track_sets;
+
+  // The same, over just the edges no dearer than max_cost, for CanReach
+  std::vector<Word> reach_node_sets;
+  std::vector<Word> reach_track_sets;
+
+  // The words each of the full sets has bits in, so neighbours are found
+  // without scanning every word
+  std::vector<size_t>       node_word_offsets;
+  std::vector<unsigned int> node_words;
+  std::vector<size_t>       track_word_offsets;
+  std::vector<unsigned int> track_words;
+
+  // Each node's edges in track order, so a candidate's edge is found by
+  // counting the neighbour bits below it
+  std::vector<GraphEdge> by_track;
+
+  // Search state
+  Tracks const*                   tracks;
+  int                             max_len;
+  size_t                          stop_len;
+  CompactMix*                     best;
+  double*                         best_cost;
+  ConvergenceTrace*               trace;
+  int                             its;
+  CompactMix                      chosen;
+  std::vector<Word>               remaining;
+  std::vector<Word>               reach;
+  std::vector<Word>               frontier;
+  std::vector<size_t>             touched;
+  std::vector<size_t>             pending;
+  std::vector<std::vector<Word> > candidates;
+
+  // Total and worst edge cost of the chosen mix up to each length, only kept
+  // for the front
+  std::vector<double>             totals;
+  std::vector<double>             worsts;
+};
+
+#endif
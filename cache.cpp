@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "cache.h"
+#include "mixant.h"
+
+// Don't bother warm-starting from a mix that shares less than this much of the set
+static const double kNearHitOverlap = 0.5;
+
+static const Hash kFNVOffset = 14695981039346656037ULL;
+static const Hash kFNVPrime  = 1099511628211ULL;
+
+static Hash HashBytes(void const* data, size_t len, Hash h = kFNVOffset)
+{
+  unsigned char const* bytes = static_cast<unsigned char const*>(data);
+  for (size_t i = 0; i < len; ++i) {
+    h ^= bytes[i];
+    h *= kFNVPrime;
+  }
+  return h;
+}
+
+// Set play keys and tempo hand-offs the same way FindMix does
+// Returns false if any transition no longer falls under the distance threshold
+static bool PropagateSteps(MixSteps& steps)
+{
+  for (size_t i = 0; i < steps.size(); ++i) {
+    MixStep& cur = steps[i];
+    cur.bpm_beg = cur.track.bpm;
+    cur.bpm_end = cur.track.bpm;
+
+    if (i == 0) {
+      cur.SetPlayKey(cur.track.key);
+      continue;
+    }
+
+    MixStep& prv = steps[i-1];
+    if (MixAnt::FindDistance(prv.bpm_beg, cur.track.bpm, prv.GetPlayKey(), cur.track.key) >= kDistThreshold) {
+      return false;
+    }
+
+    prv.bpm_end = cur.bpm_beg;
+    cur.SetPlayKey(MixAnt::ChoosePlayKey(prv.GetPlayKey(), cur.track.key));
+  }
+  return true;
+}
+
+MixCache::MixCache(std::string const& path, Hash params) : path(path), params(params)
+{
+  Load();
+}
+
+Hash MixCache::HashParams(CostModel cost, CostAggregate aggregate, int runs, unsigned long seed)
+{
+  // Fixed widths, so the same options hash the same on every platform
+  int cost_idx = cost;
+  int aggregate_idx = aggregate;
+  unsigned long long seed_bits = seed;
+
+  Hash h = kFNVOffset;
+  h = HashBytes(&kDistThreshold, sizeof(kDistThreshold), h);
+  h = HashBytes(&kBPMThresh, sizeof(kBPMThresh), h);
+  h = HashBytes(&kKeyShiftThresh, sizeof(kKeyShiftThresh), h);
+  h = HashBytes(&kMixSongLen, sizeof(kMixSongLen), h);
+  h = HashBytes(&cost_idx, sizeof(cost_idx), h);
+  h = HashBytes(&aggregate_idx, sizeof(aggregate_idx), h);
+  h = HashBytes(&runs, sizeof(runs), h);
+  h = HashBytes(&seed_bits, sizeof(seed_bits), h);
+  return h;
+}
+
+Hash MixCache::HashTrack(std::string const& name, Track const& track)
+{
+  int key_idx = Key::GetKeyIndex(track.key);
+  Hash h = HashBytes(name.data(), name.size());
+  h = HashBytes(&key_idx, sizeof(key_idx), h);
+  h = HashBytes(&track.bpm, sizeof(track.bpm), h);
+  return h;
+}
+
+// Order-independent, so reordering the source file is still an exact hit
+Hash MixCache::HashTrackSet(std::vector<Hash> const& track_hashes)
+{
+  std::vector<Hash> sorted(track_hashes);
+  std::sort(sorted.begin(), sorted.end());
+  return sorted.empty() ? kFNVOffset : HashBytes(&sorted[0], sorted.size() * sizeof(Hash));
+}
+
+MixCache::Result MixCache::Lookup(
+  Tracks const& tracks,
+  std::vector<std::string> const& names,
+  Mix& mix
+  ) const
+{
+  std::vector<Hash> hashes(tracks.size());
+  std::multimap<Hash, int> by_hash;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    hashes[i] = HashTrack(names[tracks[i].idx], tracks[i]);
+    by_hash.insert(std::make_pair(hashes[i], static_cast<int>(i)));
+  }
+
+  Hash set_hash = HashTrackSet(hashes);
+  Hash param_hash = params;
+
+  // Find the entry that shares the most tracks with us
+  Entry const* best = nullptr;
+  size_t best_shared = 0;
+  for (auto const& e : entries) {
+    if (e.param_hash != param_hash) {
+      continue;
+    }
+    if (e.set_hash == set_hash) {
+      best = &e;
+      best_shared = tracks.size();
+      break;
+    }
+
+    std::multiset<Hash> cached(e.tracks.begin(), e.tracks.end());
+    size_t shared = 0;
+    for (auto h : hashes) {
+      auto it = cached.find(h);
+      if (it != cached.end()) {
+        cached.erase(it);
+        ++shared;
+      }
+    }
+    if (shared > best_shared) {
+      best = &e;
+      best_shared = shared;
+    }
+  }
+
+  size_t union_size = best ? tracks.size() + best->tracks.size() - best_shared : 0;
+  if (!best || best_shared < kNearHitOverlap * union_size) {
+    return kMiss;
+  }
+
+  // Resolve cached steps to our tracks, dropping any that have gone away
+  // Each track can only be used once, even if it's duplicated in the library
+  std::multimap<Hash, int> unused(by_hash);
+  std::vector<MixSteps> segments(1);
+  for (auto const& s : best->steps) {
+    auto it = unused.find(s.track);
+    if (it == unused.end()) {
+      segments.push_back(MixSteps());
+      continue;
+    }
+
+    MixStep step(tracks[it->second]);
+    step.SetPlayKey(Key::GetKeys()[s.play_key]);
+    step.bpm_beg = s.bpm_beg;
+    step.bpm_end = s.bpm_end;
+    segments.back().push_back(step);
+    unused.erase(it);
+  }
+
+  // Exact hits come back untouched
+  if (best->set_hash == set_hash && segments.size() == 1) {
+    mix.steps = segments.front();
+    return kExact;
+  }
+
+  // Removing tracks can make neighbours incompatible, so split further at any
+  // broken transition and keep the longest piece we have left
+  MixSteps kept;
+  for (auto& seg : segments) {
+    MixSteps piece;
+    for (auto const& step : seg) {
+      MixSteps attempt(piece);
+      attempt.push_back(step);
+      if (!PropagateSteps(attempt)) {
+        if (piece.size() > kept.size()) {
+          kept = piece;
+        }
+        attempt.assign(1, step);
+        PropagateSteps(attempt);
+      }
+      piece = attempt;
+    }
+    if (piece.size() > kept.size()) {
+      kept = piece;
+    }
+  }
+
+  // Offer the tracks that weren't in the cached mix for insertion wherever
+  // they fit most cheaply
+  std::multiset<Hash> cached(best->tracks.begin(), best->tracks.end());
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    auto it = cached.find(hashes[i]);
+    if (it != cached.end()) {
+      cached.erase(it);
+      continue;
+    }
+
+    Mix best_insert;
+    double best_insert_dist = DBL_MAX;
+    for (size_t pos = 0; pos <= kept.size(); ++pos) {
+      Mix attempt;
+      attempt.steps = kept;
+      attempt.steps.insert(attempt.steps.begin() + pos, MixStep(tracks[i]));
+      if (!PropagateSteps(attempt.steps)) {
+        continue;
+      }
+      double dist = attempt.CalculateDistance();
+      if (dist < best_insert_dist) {
+        best_insert_dist = dist;
+        best_insert = attempt;
+      }
+    }
+
+    if (!best_insert.steps.empty()) {
+      kept = best_insert.steps;
+    }
+  }
+
+  mix.steps = kept;
+  return kNear;
+}
+
+void MixCache::Store(
+  Tracks const& tracks,
+  std::vector<std::string> const& names,
+  Mix const& mix
+  )
+{
+  Entry e;
+  e.tracks.reserve(tracks.size());
+  for (auto const& t : tracks) {
+    e.tracks.push_back(HashTrack(names[t.idx], t));
+  }
+  e.set_hash = HashTrackSet(e.tracks);
+  e.param_hash = params;
+
+  for (auto const& s : mix.steps) {
+    Step step;
+    step.track = HashTrack(names[s.track.idx], s.track);
+    step.play_key = Key::GetKeyIndex(s.GetPlayKey());
+    step.bpm_beg = s.bpm_beg;
+    step.bpm_end = s.bpm_end;
+    e.steps.push_back(step);
+  }
+
+  // Replace any previous result for the same problem
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->set_hash == e.set_hash && it->param_hash == e.param_hash) {
+      entries.erase(it);
+      break;
+    }
+  }
+  entries.push_back(e);
+
+  Save();
+}
+
+// Format is one entry header followed by its track hashes and mix steps:
+// mix <set hash> <param hash> <num tracks> <num steps>
+// <track hash> (one per line)
+// <track hash> <play key index> <bpm beg> <bpm end> (one per line)
+void MixCache::Load()
+{
+  entries.clear();
+
+  std::ifstream ifs(path);
+  std::string line;
+  while (getline(ifs, line)) {
+    std::stringstream ss(line);
+    std::string tag;
+    Entry e;
+    size_t num_tracks, num_steps;
+    ss >> tag >> e.set_hash >> e.param_hash >> num_tracks >> num_steps;
+    if (!ss || tag.compare("mix")) {
+      break;
+    }
+
+    e.tracks.resize(num_tracks);
+    for (size_t i = 0; i < num_tracks; ++i) {
+      ifs >> e.tracks[i];
+    }
+    e.steps.resize(num_steps);
+    for (size_t i = 0; i < num_steps; ++i) {
+      ifs >> e.steps[i].track >> e.steps[i].play_key >> e.steps[i].bpm_beg >> e.steps[i].bpm_end;
+    }
+
+    // Ignore anything truncated or corrupt
+    if (!ifs) {
+      break;
+    }
+    getline(ifs, line);
+    entries.push_back(e);
+  }
+  ifs.close();
+}
+
+void MixCache::Save() const
+{
+  std::ofstream ofs(path);
+  ofs.precision(17);
+  for (auto const& e : entries) {
+    ofs << "mix " << e.set_hash << " " << e.param_hash << " " << e.tracks.size() << " " << e.steps.size() << std::endl;
+    for (auto h : e.tracks) {
+      ofs << h << std::endl;
+    }
+    for (auto const& s : e.steps) {
+      ofs << s.track << " " << s.play_key << " " << s.bpm_beg << " " << s.bpm_end << std::endl;
+    }
+  }
+  ofs.close();
+}
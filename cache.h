@@ -0,0 +1,79 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "costs.h"
+#include "mix.h"
+#include "track.h"
+
+typedef unsigned long long Hash;
+
+// A persistent store of solved mixes
+// Entries are keyed by a hash of the track set plus the solver parameters
+// (see HashParams), so an unchanged library gets its mix back instantly, and
+// a slightly changed one gets a repaired version of the old mix to
+// warm-start the solver with
+class MixCache
+{
+public:
+
+  enum Result
+  {
+    kMiss,
+    kExact,
+    kNear
+  };
+
+  // params is the HashParams of the solves whose mixes we look up and store
+  MixCache(std::string const& path, Hash params);
+
+  // Fills in mix on a hit
+  // On a near hit the mix only holds tracks still in the set, plus any new
+  // tracks that could be slotted in, and should be used as a solver seed
+  Result Lookup(
+    Tracks const& tracks,
+    std::vector<std::string> const& names,
+    Mix& mix
+    ) const;
+
+  void Store(
+    Tracks const& tracks,
+    std::vector<std::string> const& names,
+    Mix const& mix
+    );
+
+  // Everything a solve's result depends on besides the tracks: the
+  // thresholds, and how the mix was priced and searched for
+  static Hash HashParams(CostModel cost, CostAggregate aggregate, int runs, unsigned long seed);
+  static Hash HashTrack(std::string const& name, Track const& track);
+  static Hash HashTrackSet(std::vector<Hash> const& track_hashes);
+
+protected:
+
+  struct Step
+  {
+    Hash   track;
+    int    play_key;
+    double bpm_beg;
+    double bpm_end;
+  };
+
+  struct Entry
+  {
+    Hash              set_hash;
+    Hash              param_hash;
+    std::vector<Hash> tracks;
+    std::vector<Step> steps;
+  };
+
+  void Load();
+  void Save() const;
+
+  std::string        path;
+  Hash               params;
+  std::vector<Entry> entries;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include "classes.h"
+
+void TrackClasses::Build(Tracks const& tracks, double bpm_tolerance)
+{
+  // Sorting by key and then tempo puts each class in one run
+  std::vector<Track const*> sorted;
+  sorted.reserve(tracks.size());
+  for (auto const& t : tracks) {
+    sorted.push_back(&t);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](Track const* a, Track const* b)
+  {
+    int ka = Key::GetKeyIndex(a->key);
+    int kb = Key::GetKeyIndex(b->key);
+    return ka < kb || (ka == kb && (a->bpm < b->bpm || (a->bpm == b->bpm && a->idx < b->idx)));
+  });
+
+  classes.clear();
+  Track const* first = nullptr;
+  for (auto t : sorted) {
+    if (!first || !(t->key == first->key) || t->bpm - first->bpm > bpm_tolerance) {
+      classes.push_back(std::vector<int>());
+      first = t;
+    }
+    classes.back().push_back(t->idx);
+  }
+
+  int max_idx = -1;
+  for (auto const& t : tracks) {
+    max_idx = std::max(max_idx, t.idx);
+  }
+  rep_classes.assign(max_idx + 1, -1);
+  for (size_t c = 0; c < classes.size(); ++c) {
+    rep_classes[classes[c].front()] = static_cast<int>(c);
+  }
+}
+
+size_t TrackClasses::GetNumClasses() const
+{
+  return classes.size();
+}
+
+std::vector<int> TrackClasses::GetRepresentatives() const
+{
+  std::vector<int> reps;
+  reps.reserve(classes.size());
+  for (auto const& c : classes) {
+    reps.push_back(c.front());
+  }
+  return reps;
+}
+
+std::vector<int> const& TrackClasses::GetMembers(size_t cls) const
+{
+  return classes[cls];
+}
+
+static bool HasEdge(CompatibilityGraph const& graph, int from, int to)
+{
+  if (from < 0 || to < 0) {
+    return false;
+  }
+  for (auto e = graph.EdgesBegin(from); e != graph.EdgesEnd(from); ++e) {
+    if (e->node == to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Mix TrackClasses::Expand(
+  Mix const& mix,
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  size_t max_len
+  ) const
+{
+  // Every representative stays, and the rest fill up whatever room is left
+  size_t extras = max_len > mix.steps.size() ? max_len - mix.steps.size() : 0;
+
+  Mix expanded;
+  for (size_t i = 0; i < mix.steps.size(); ++i) {
+    MixStep const& s = mix.steps[i];
+    expanded.steps.push_back(s);
+
+    int idx = s.track.idx;
+    int cls = idx < static_cast<int>(rep_classes.size()) ? rep_classes[idx] : -1;
+    if (cls < 0) {
+      continue;
+    }
+
+    // The mix went from the representative to the next track, so each member
+    // that goes in has to be able to carry on there just the same
+    int next = -1;
+    if (i + 1 < mix.steps.size()) {
+      next = graph.GetNode(mix.steps[i+1].track.idx, mix.steps[i+1].GetPlayKey());
+    }
+    int last = graph.GetNode(idx, s.GetPlayKey());
+
+    std::vector<int> const& members = classes[cls];
+    for (size_t m = 1; m < members.size() && extras > 0; ++m) {
+      int node = graph.GetNode(members[m], s.GetPlayKey());
+      if (!HasEdge(graph, last, node) || (i + 1 < mix.steps.size() && !HasEdge(graph, node, next))) {
+        continue;
+      }
+      MixStep step(tracks[members[m]]);
+      step.SetPlayKey(s.GetPlayKey());
+      expanded.steps.push_back(step);
+      last = node;
+      --extras;
+    }
+  }
+
+  // Each track hands over at the next one's tempo
+  for (size_t i = 0; i + 1 < expanded.steps.size(); ++i) {
+    expanded.steps[i].bpm_end = expanded.steps[i+1].bpm_beg;
+  }
+  expanded.CalculateDistance();
+  return expanded;
+}
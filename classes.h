@@ -0,0 +1,54 @@
+#ifndef CLASSES_H
+#define CLASSES_H
+
+#include <cstdint>
+#include <vector>
+
+#include "graph.h"
+#include "mix.h"
+#include "track.h"
+
+// Merges tracks that are interchangeable as far as mixing goes: the same key,
+// and tempos no more than a tolerance above the slowest in their class
+// Solvers then only see one track per class, so big crates full of
+// near-duplicates don't multiply their branching, and the other members are
+// put back next to their representative afterwards (where the transitions
+// between them are as cheap as transitions get)
+class TrackClasses
+{
+public:
+
+  // Members are recorded by Track::idx
+  void Build(Tracks const& tracks, double bpm_tolerance);
+
+  size_t GetNumClasses() const;
+
+  // Slowest member of each class, by Track::idx
+  std::vector<int> GetRepresentatives() const;
+
+  // Members of a class, slowest first
+  std::vector<int> const& GetMembers(size_t cls) const;
+
+  // Replaces every representative in a mix with its whole class (playing in
+  // the representative's key), and rescores it
+  // A member only goes in where graph (over tracks, with the rule the mix was
+  // solved with) has edges into it and on to the next track, so every
+  // transition stays compatible, and members beyond the representatives are
+  // only added up to max_len tracks
+  // tracks is indexed by Track::idx
+  Mix Expand(
+    Mix const& mix,
+    Tracks const& tracks,
+    CompatibilityGraph const& graph,
+    size_t max_len = SIZE_MAX
+    ) const;
+
+protected:
+
+  std::vector<std::vector<int> > classes;
+
+  // Class of each representative, by Track::idx
+  std::vector<int> rep_classes;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "compact.h"
+
+// Tempos are stored in hundredths of a BPM
+static const double kBPMScale = 100;
+
+// Unchanged tempos come back exactly rather than rounded
+static double Dequantize(unsigned short q, double natural)
+{
+  return q == CompactMix::QuantizeBPM(natural) ? natural : CompactMix::DequantizeBPM(q);
+}
+
+CompactMix::CompactMix() : cost(0)
+{
+}
+
+void CompactMix::Push(int track, Key const& play_key, double beg, double end)
+{
+  order.push_back(track);
+  keys.push_back(static_cast<unsigned char>(Key::GetKeyIndex(play_key)));
+  bpm_beg.push_back(QuantizeBPM(beg));
+  bpm_end.push_back(QuantizeBPM(end));
+}
+
+void CompactMix::Pop()
+{
+  order.pop_back();
+  keys.pop_back();
+  bpm_beg.pop_back();
+  bpm_end.pop_back();
+}
+
+void CompactMix::Clear()
+{
+  order.clear();
+  keys.clear();
+  bpm_beg.clear();
+  bpm_end.clear();
+  cost = 0;
+}
+
+size_t CompactMix::size() const
+{
+  return order.size();
+}
+
+bool CompactMix::empty() const
+{
+  return order.empty();
+}
+
+Key CompactMix::GetPlayKey(size_t pos) const
+{
+  return Key::GetKeys()[keys[pos]];
+}
+
+double CompactMix::GetBPMBeg(size_t pos, Tracks const& tracks) const
+{
+  return Dequantize(bpm_beg[pos], tracks[order[pos]].bpm);
+}
+
+double CompactMix::GetBPMEnd(size_t pos, Tracks const& tracks) const
+{
+  return Dequantize(bpm_end[pos], tracks[order[pos]].bpm);
+}
+
+Mix CompactMix::Materialize(Tracks const& tracks) const
+{
+  Mix mix;
+  mix.steps.reserve(size());
+  for (size_t i = 0; i < size(); ++i) {
+    MixStep step(tracks[order[i]]);
+    step.SetPlayKey(GetPlayKey(i));
+    step.bpm_beg = GetBPMBeg(i, tracks);
+    step.bpm_end = GetBPMEnd(i, tracks);
+    mix.AddStep(step);
+  }
+  return mix;
+}
+
+CompactMix CompactMix::FromMix(Mix const& mix)
+{
+  CompactMix compact;
+  compact.order.reserve(mix.steps.size());
+  compact.keys.reserve(mix.steps.size());
+  compact.bpm_beg.reserve(mix.steps.size());
+  compact.bpm_end.reserve(mix.steps.size());
+  for (auto const& s : mix.steps) {
+    compact.Push(s.track.idx, s.GetPlayKey(), s.bpm_beg, s.bpm_end);
+  }
+  compact.cost = mix.GetTotalCost();
+  return compact;
+}
+
+unsigned short CompactMix::QuantizeBPM(double bpm)
+{
+  double q = std::min(std::max(bpm * kBPMScale + 0.5, 0.0), 65535.0);
+  return static_cast<unsigned short>(q);
+}
+
+double CompactMix::DequantizeBPM(unsigned short q)
+{
+  return q / kBPMScale;
+}
@@ -0,0 +1,41 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <vector>
+
+#include "mix.h"
+#include "track.h"
+
+// A mix packed down to what we need to rebuild it later: a track index, a
+// play key index and a quantized tempo ramp per step
+// At a few bytes per step, solvers can hold on to lots of candidates cheaply
+// and only materialize full MixSteps for output
+struct CompactMix
+{
+  CompactMix();
+
+  void   Push(int track, Key const& play_key, double bpm_beg, double bpm_end);
+  void   Pop();
+  void   Clear();
+  size_t size() const;
+  bool   empty() const;
+
+  Key    GetPlayKey(size_t pos) const;
+  double GetBPMBeg(size_t pos, Tracks const& tracks) const;
+  double GetBPMEnd(size_t pos, Tracks const& tracks) const;
+
+  Mix Materialize(Tracks const& tracks) const;
+
+  static CompactMix FromMix(Mix const& mix);
+
+  static unsigned short QuantizeBPM(double bpm);
+  static double         DequantizeBPM(unsigned short q);
+
+  std::vector<int>            order;
+  std::vector<unsigned char>  keys;
+  std::vector<unsigned short> bpm_beg;
+  std::vector<unsigned short> bpm_end;
+  double                      cost;
+};
+
+#endif
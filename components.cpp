@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <numeric>
+
+#include "components.h"
+
+GraphComponents::GraphComponents() : num_components(0)
+{
+  dag_offsets.assign(1, 0);
+}
+
+void GraphComponents::Build(CompatibilityGraph const& graph)
+{
+  FindComponents(graph);
+  BuildDAG(graph);
+  FindGroups(graph);
+}
+
+// Tarjan's algorithm, with an explicit stack since paths can run through
+// every node in the graph
+void GraphComponents::FindComponents(CompatibilityGraph const& graph)
+{
+  struct Frame
+  {
+    int              node;
+    GraphEdge const* next;
+  };
+
+  int num_nodes = static_cast<int>(graph.GetNumNodes());
+  std::vector<int> index(num_nodes, -1);
+  std::vector<int> low(num_nodes);
+  std::vector<bool> on_stack(num_nodes);
+  std::vector<int> stack;
+  std::vector<Frame> calls;
+  int counter = 0;
+
+  components.assign(num_nodes, -1);
+  num_components = 0;
+
+  for (int root = 0; root < num_nodes; ++root) {
+    if (index[root] >= 0) {
+      continue;
+    }
+    index[root] = low[root] = counter++;
+    stack.push_back(root);
+    on_stack[root] = true;
+    Frame start = { root, graph.EdgesBegin(root) };
+    calls.push_back(start);
+
+    while (!calls.empty()) {
+      Frame& f = calls.back();
+      int v = f.node;
+
+      if (f.next != graph.EdgesEnd(v)) {
+        int w = (f.next++)->node;
+        if (index[w] < 0) {
+          index[w] = low[w] = counter++;
+          stack.push_back(w);
+          on_stack[w] = true;
+          Frame call = { w, graph.EdgesBegin(w) };
+          calls.push_back(call);
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], index[w]);
+        }
+        continue;
+      }
+
+      calls.pop_back();
+      if (!calls.empty()) {
+        int parent = calls.back().node;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+
+      // v is the root of a component, which is everything above it
+      if (low[v] == index[v]) {
+        int w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          on_stack[w] = false;
+          components[w] = static_cast<int>(num_components);
+        } while (w != v);
+        ++num_components;
+      }
+    }
+  }
+}
+
+void GraphComponents::BuildDAG(CompatibilityGraph const& graph)
+{
+  int num_nodes = static_cast<int>(graph.GetNumNodes());
+
+  // Group the nodes by component
+  std::vector<size_t> member_offsets(num_components + 1, 0);
+  for (int n = 0; n < num_nodes; ++n) {
+    ++member_offsets[components[n] + 1];
+  }
+  std::partial_sum(member_offsets.begin(), member_offsets.end(), member_offsets.begin());
+  std::vector<int> members(num_nodes);
+  std::vector<size_t> fill(member_offsets.begin(), member_offsets.end() - 1);
+  for (int n = 0; n < num_nodes; ++n) {
+    members[fill[components[n]]++] = n;
+  }
+
+  // Marks hold the last component to count a track, or link to a component
+  std::vector<int> track_marks(graph.GetNumTracks(), -1);
+  std::vector<int> link_marks(num_components, -1);
+
+  num_tracks.assign(num_components, 0);
+  longest.assign(num_components, 0);
+  dag_offsets.assign(1, 0);
+  dag_edges.clear();
+
+  // Tarjan finishes a component only after everything it leads to, so every
+  // edge goes to a lower number and longest paths can be filled in order
+  for (size_t c = 0; c < num_components; ++c) {
+    int comp = static_cast<int>(c);
+    size_t longest_next = 0;
+    for (size_t m = member_offsets[c]; m < member_offsets[c+1]; ++m) {
+      int n = members[m];
+      int t = graph.GetTrack(n);
+      if (track_marks[t] != comp) {
+        track_marks[t] = comp;
+        ++num_tracks[c];
+      }
+      for (auto e = graph.EdgesBegin(n); e != graph.EdgesEnd(n); ++e) {
+        int d = components[e->node];
+        if (d != comp && link_marks[d] != comp) {
+          link_marks[d] = comp;
+          dag_edges.push_back(d);
+          longest_next = std::max(longest_next, longest[d]);
+        }
+      }
+    }
+    longest[c] = num_tracks[c] + longest_next;
+    dag_offsets.push_back(dag_edges.size());
+  }
+}
+
+void GraphComponents::FindGroups(CompatibilityGraph const& graph)
+{
+  int num_tracks = static_cast<int>(graph.GetNumTracks());
+
+  // Union-find over the tracks, joining both ends of every edge
+  std::vector<int> parents(num_tracks);
+  std::iota(parents.begin(), parents.end(), 0);
+  auto find = [&](int t)
+  {
+    while (parents[t] != t) {
+      parents[t] = parents[parents[t]];
+      t = parents[t];
+    }
+    return t;
+  };
+  for (int n = 0; n < static_cast<int>(graph.GetNumNodes()); ++n) {
+    for (auto e = graph.EdgesBegin(n); e != graph.EdgesEnd(n); ++e) {
+      int a = find(graph.GetTrack(n));
+      int b = find(graph.GetTrack(e->node));
+      if (a != b) {
+        parents[std::max(a, b)] = std::min(a, b);
+      }
+    }
+  }
+
+  // Groups are numbered by their lowest track
+  std::vector<int> group_of(num_tracks, -1);
+  groups.clear();
+  for (int t = 0; t < num_tracks; ++t) {
+    int root = find(t);
+    if (group_of[root] < 0) {
+      group_of[root] = static_cast<int>(groups.size());
+      TrackGroup g;
+      g.bound = 0;
+      groups.push_back(g);
+    }
+    group_of[t] = group_of[root];
+    groups[group_of[t]].tracks.push_back(t);
+  }
+
+  for (int n = 0; n < static_cast<int>(graph.GetNumNodes()); ++n) {
+    TrackGroup& g = groups[group_of[graph.GetTrack(n)]];
+    g.bound = std::max(g.bound, longest[components[n]]);
+  }
+  for (auto& g : groups) {
+    g.bound = std::min(g.bound, g.tracks.size());
+  }
+
+  std::stable_sort(groups.begin(), groups.end(), [](TrackGroup const& a, TrackGroup const& b)
+  {
+    return a.bound > b.bound;
+  });
+}
+
+size_t GraphComponents::GetNumComponents() const
+{
+  return num_components;
+}
+
+int GraphComponents::GetComponent(int node) const
+{
+  return components[node];
+}
+
+size_t GraphComponents::GetNumTracks(int component) const
+{
+  return num_tracks[component];
+}
+
+size_t GraphComponents::GetLongestFrom(int component) const
+{
+  return longest[component];
+}
+
+TrackGroups const& GraphComponents::GetGroups() const
+{
+  return groups;
+}
+
+size_t GraphComponents::GetBound() const
+{
+  return groups.empty() ? 0 : groups.front().bound;
+}
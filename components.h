@@ -0,0 +1,81 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+
+#include "graph.h"
+
+// Tracks that can be reached from each other (ignoring direction), so no mix
+// ever joins two groups
+struct TrackGroup
+{
+  std::vector<int> tracks;
+
+  // Upper bound on how many of these tracks one mix can play
+  size_t bound;
+};
+
+typedef std::vector<TrackGroup> TrackGroups;
+
+// Splits a compatibility graph into strongly connected components, and links
+// those into a condensation DAG (which can't have cycles, so the longest path
+// through it is cheap to find)
+// A mix can play at most every track of each component it passes through, so
+// the longest DAG path, counting each component's tracks, bounds how long any
+// mix can be. That lets the solvers stop as soon as they reach it, rather than
+// searching for something longer that can't exist
+class GraphComponents
+{
+public:
+
+  GraphComponents();
+
+  void Build(CompatibilityGraph const& graph);
+
+  size_t GetNumComponents() const;
+
+  // Component of each graph node
+  // Components are numbered so every DAG edge goes to a lower number
+  int GetComponent(int node) const;
+
+  // Distinct tracks among a component's nodes
+  size_t GetNumTracks(int component) const;
+
+  // DAG edges out of a component
+  int const* EdgesBegin(int component) const
+  {
+    return dag_edges.data() + dag_offsets[component];
+  }
+
+  int const* EdgesEnd(int component) const
+  {
+    return dag_edges.data() + dag_offsets[component+1];
+  }
+
+  // Most tracks a mix starting in a component could play
+  size_t GetLongestFrom(int component) const;
+
+  // Biggest bound first
+  TrackGroups const& GetGroups() const;
+
+  // Bound on the longest mix over the whole graph
+  size_t GetBound() const;
+
+protected:
+
+  void FindComponents(CompatibilityGraph const& graph);
+  void BuildDAG(CompatibilityGraph const& graph);
+  void FindGroups(CompatibilityGraph const& graph);
+
+  std::vector<int>    components;
+  size_t              num_components;
+  std::vector<size_t> num_tracks;
+  std::vector<size_t> longest;
+
+  std::vector<size_t> dag_offsets;
+  std::vector<int>    dag_edges;
+
+  TrackGroups groups;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef COSTS_H
+#define COSTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "mix.h"
+#include "track.h"
+#include "transition.h"
+
+// Cost and aggregation policies, passed to the solvers as template parameters
+// so that every combination gets its own inner loop with the cost inlined
+// The enums pick one at runtime, through a table of instantiations in each
+// solver
+
+// What a single transition costs
+enum CostModel
+{
+  // Whatever the compatibility rule has always used (kCostTransition for
+  // kRuleDistance, kCostKeyShift for kRuleKeyShift)
+  kCostDefault,
+  kCostTransition,
+  kCostKeyShift
+};
+
+// How transition costs add up to the cost of a mix
+enum CostAggregate
+{
+  kAggregateSum,
+  kAggregateMax
+};
+
+// Cost policies price going from one track to the next, with next the
+// TransitionTable entry for the key from plays in and to's own key
+
+// Tempo change and transposition, in semitones (as MixAnt::FindDistance)
+struct TransitionCost
+{
+  static double Cost(double bpm_dist, int key_dist)
+  {
+    double tuning_dist = bpm_dist - key_dist;
+    return std::abs(tuning_dist) + std::max(std::abs(bpm_dist), std::abs(static_cast<double>(key_dist)));
+  }
+
+  static double Edge(Track const& from, Track const& to, Transition const& next)
+  {
+    return Cost(from.log_bpm - to.log_bpm, next.transpose);
+  }
+};
+
+// Tempo ratio plus key shift, as AreCompatibleTracks
+// It's cheaper to adjust tempo (less noticeable) than to adjust key
+struct KeyShiftCost
+{
+  static double Edge(Track const& from, Track const& to, Transition const& next)
+  {
+    double bpm_rat = std::max(from.bpm, to.bpm) / std::min(from.bpm, to.bpm);
+    return (bpm_rat - 1) + std::abs(next.shift);
+  }
+};
+
+// Aggregates never go down as transitions are added, which the solvers'
+// pruning relies on
+
+struct SumCost
+{
+  static double Add(double total, double edge)
+  {
+    return total + edge;
+  }
+
+  static double Of(Mix const& m)
+  {
+    return m.GetTotalCost();
+  }
+};
+
+// Only the worst transition counts
+struct MaxCost
+{
+  static double Add(double total, double edge)
+  {
+    return std::max(total, edge);
+  }
+
+  static double Of(Mix const& m)
+  {
+    return m.GetMaxCost();
+  }
+};
+
+inline double GetMixCost(Mix const& m, CostAggregate aggregate)
+{
+  return aggregate == kAggregateMax ? MaxCost::Of(m) : SumCost::Of(m);
+}
+
+#endif
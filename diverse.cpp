@@ -0,0 +1,156 @@
+#include <algorithm>
+
+#include "diverse.h"
+
+DiverseMixes::DiverseMixes(size_t count, double min_distance) : count(count), min_distance(min_distance)
+{
+}
+
+bool DiverseMixes::Better(size_t len_a, double cost_a, size_t len_b, double cost_b)
+{
+  return len_a > len_b || (len_a == len_b && cost_a < cost_b);
+}
+
+void DiverseMixes::FindTransitions(CompactMix const& mix, std::vector<uint64_t>& transitions)
+{
+  transitions.clear();
+  for (size_t i = 1; i < mix.size(); ++i) {
+    transitions.push_back(uint64_t(uint32_t(mix.order[i-1])) << 32 | uint32_t(mix.order[i]));
+  }
+  std::sort(transitions.begin(), transitions.end());
+}
+
+double DiverseMixes::Distance(Entry const& a, Entry const& b)
+{
+  size_t most = std::max(a.transitions.size(), b.transitions.size());
+
+  // Single tracks have no transitions to compare
+  if (most == 0) {
+    return a.mix.order == b.mix.order ? 0 : 1;
+  }
+
+  size_t shared = 0;
+  auto i = a.transitions.begin();
+  auto j = b.transitions.begin();
+  while (i != a.transitions.end() && j != b.transitions.end()) {
+    if (*i < *j) {
+      ++i;
+    } else if (*j < *i) {
+      ++j;
+    } else {
+      ++shared;
+      ++i;
+      ++j;
+    }
+  }
+  return 1 - static_cast<double>(shared) / most;
+}
+
+double DiverseMixes::Distance(CompactMix const& a, CompactMix const& b)
+{
+  Entry ea;
+  Entry eb;
+  ea.mix = a;
+  eb.mix = b;
+  FindTransitions(a, ea.transitions);
+  FindTransitions(b, eb.transitions);
+  return Distance(ea, eb);
+}
+
+bool DiverseMixes::Accepts(size_t length, double cost) const
+{
+  // The heap keeps the worst mix up front
+  return count > 0 && (entries.size() < count || Better(length, cost, entries.front().length, entries.front().cost));
+}
+
+bool DiverseMixes::Offer(size_t length, double cost, CompactMix const& mix)
+{
+  if (!Accepts(length, cost)) {
+    return false;
+  }
+
+  Entry entry;
+  entry.length = length;
+  entry.cost = cost;
+  entry.mix = mix;
+  entry.mix.cost = cost;
+  FindTransitions(mix, entry.transitions);
+
+  // Anything too close has to be worse, and then makes way
+  std::vector<bool> close(entries.size());
+  bool any_close = false;
+  for (size_t e = 0; e < entries.size(); ++e) {
+    if (Distance(entry, entries[e]) < min_distance) {
+      if (!Better(length, cost, entries[e].length, entries[e].cost)) {
+        return false;
+      }
+      close[e] = true;
+      any_close = true;
+    }
+  }
+
+  auto worse = [](Entry const& a, Entry const& b)
+  {
+    return Better(a.length, a.cost, b.length, b.cost);
+  };
+
+  if (any_close) {
+    size_t kept = 0;
+    for (size_t e = 0; e < entries.size(); ++e) {
+      if (!close[e]) {
+        std::swap(entries[kept++], entries[e]);
+      }
+    }
+    entries.resize(kept);
+    std::make_heap(entries.begin(), entries.end(), worse);
+  } else if (entries.size() >= count) {
+    std::pop_heap(entries.begin(), entries.end(), worse);
+    entries.pop_back();
+  }
+
+  entries.push_back(entry);
+  std::push_heap(entries.begin(), entries.end(), worse);
+  return true;
+}
+
+void DiverseMixes::Merge(DiverseMixes const& mixes)
+{
+  for (auto const& e : mixes.entries) {
+    Offer(e.length, e.cost, e.mix);
+  }
+}
+
+void DiverseMixes::Clear()
+{
+  entries.clear();
+}
+
+size_t DiverseMixes::GetCount() const
+{
+  return count;
+}
+
+double DiverseMixes::GetMinDistance() const
+{
+  return min_distance;
+}
+
+std::vector<CompactMix> DiverseMixes::GetMixes() const
+{
+  std::vector<Entry> sorted(entries);
+  std::sort(sorted.begin(), sorted.end(), [](Entry const& a, Entry const& b)
+  {
+    return Better(a.length, a.cost, b.length, b.cost);
+  });
+
+  std::vector<CompactMix> mixes;
+  for (auto const& e : sorted) {
+    mixes.push_back(e.mix);
+  }
+  return mixes;
+}
+
+size_t DiverseMixes::size() const
+{
+  return entries.size();
+}
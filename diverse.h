@@ -0,0 +1,67 @@
+#ifndef DIVERSE_H
+#define DIVERSE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "compact.h"
+
+// How different two mixes must be by default: half their transitions
+static const double kDefaultDiversity = 0.5;
+
+// The best few mixes a solver comes across (longer, then cheaper), no two of
+// which are too alike, so one solve can hand back several real alternatives
+// Two mixes are as far apart as the share of transitions (ordered pairs of
+// tracks played back to back) they don't have in common, out of the longer
+// A mix too close to one that's kept only gets in by beating it, and then
+// takes its place
+// Kept in a bounded heap with the worst on top, so most mixes are turned
+// away with one comparison before they're ever packed down
+// Not thread safe: solvers running at once each keep their own and Merge
+class DiverseMixes
+{
+public:
+
+  DiverseMixes(size_t count = 0, double min_distance = kDefaultDiversity);
+
+  // Could a mix this long and expensive be kept?
+  bool Accepts(size_t length, double cost) const;
+
+  // Keeps the mix if it's good enough and different enough
+  bool Offer(size_t length, double cost, CompactMix const& mix);
+
+  void Merge(DiverseMixes const& mixes);
+  void Clear();
+
+  size_t GetCount() const;
+  double GetMinDistance() const;
+
+  // Best first, each with its cost
+  std::vector<CompactMix> GetMixes() const;
+
+  size_t size() const;
+
+  // Share of transitions a and b don't have in common, from 0 (the same
+  // transitions) to 1 (none shared)
+  static double Distance(CompactMix const& a, CompactMix const& b);
+
+protected:
+
+  struct Entry
+  {
+    size_t                length;
+    double                cost;
+    CompactMix            mix;
+    std::vector<uint64_t> transitions;
+  };
+
+  static bool Better(size_t len_a, double cost_a, size_t len_b, double cost_b);
+  static void FindTransitions(CompactMix const& mix, std::vector<uint64_t>& transitions);
+  static double Distance(Entry const& a, Entry const& b);
+
+  size_t             count;
+  double             min_distance;
+  std::vector<Entry> entries;
+};
+
+#endif
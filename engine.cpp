@@ -0,0 +1,723 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+#include "bitsearch.h"
+#include "classes.h"
+#include "compact.h"
+#include "engine.h"
+#include "horizon.h"
+#include "logger.h"
+#include "metrics.h"
+#include "partition.h"
+#include "search.h"
+
+SolveOptions::SolveOptions() :
+  solver(kSolverAnt),
+  runs(kMixRuns),
+  max_len(kMixSongLen),
+  window(kHorizonWindow),
+  commit(kHorizonCommit),
+  stop_len(SIZE_MAX),
+  budget(0),
+  seed(5489), // mt19937's own default, so unseeded solves match the old behaviour
+  warm_start(nullptr),
+  trace(nullptr),
+  front(nullptr),
+  alternatives(nullptr),
+  threads(0),
+  class_bpm(-1),
+  cost(kCostDefault),
+  aggregate(kAggregateSum)
+{
+}
+
+Engine::Engine()
+{
+  graphs_built[kRuleDistance] = false;
+  graphs_built[kRuleKeyShift] = false;
+}
+
+void Engine::Load(std::string const& path)
+{
+  library.Load(path);
+  BuildIndices(false);
+}
+
+bool Engine::Poll()
+{
+  if (!library.Poll()) {
+    return false;
+  }
+  BuildIndices(true);
+  return true;
+}
+
+void Engine::BuildIndices(bool update)
+{
+  if (update) {
+    neighbors.Update(library.GetTracks());
+  } else {
+    neighbors.Build(library.GetTracks());
+  }
+  scorer.Build(library.GetTracks());
+
+  std::lock_guard<std::mutex> lock(graphs_mutex);
+  graphs_built[kRuleDistance] = false;
+  graphs_built[kRuleKeyShift] = false;
+}
+
+void Engine::BuildGraph(CompatibilityRule rule) const
+{
+  std::lock_guard<std::mutex> lock(graphs_mutex);
+  if (!graphs_built[rule]) {
+    graphs[rule].Build(library.GetTracks(), rule);
+    components[rule].Build(graphs[rule]);
+    graphs_built[rule] = true;
+  }
+}
+
+CompatibilityGraph const& Engine::GetGraph(CompatibilityRule rule) const
+{
+  BuildGraph(rule);
+  return graphs[rule];
+}
+
+GraphComponents const& Engine::GetComponents(CompatibilityRule rule) const
+{
+  BuildGraph(rule);
+  return components[rule];
+}
+
+Library const& Engine::GetLibrary() const
+{
+  return library;
+}
+
+Mix Engine::Solve(SolveOptions const& options) const
+{
+  if (options.class_bpm >= 0) {
+    std::vector<int> all(library.GetTracks().size());
+    std::iota(all.begin(), all.end(), 0);
+    return SolveClasses(all, options);
+  }
+
+  CompatibilityRule rule = options.solver == kSolverExhaustive || options.solver == kSolverHorizon ? kRuleKeyShift : kRuleDistance;
+  GraphComponents const& parts = GetComponents(rule);
+
+  // Groups can't be joined, so they're best solved on their own (a warm start
+  // mix covers the whole library though)
+  if (parts.GetGroups().size() > 1 && !options.warm_start) {
+    return SolveGroups(parts.GetGroups(), options);
+  }
+
+  // No point looking for a mix longer than the graph allows, but the search
+  // still has to find the cheapest mix of the longest length
+  SolveOptions bounded(options);
+  bounded.max_len = std::min(options.max_len, parts.GetBound() + 1);
+
+  // The shared graph has the rule's own costs, so any other cost model needs
+  // a graph of its own (with the same edges, so the bound still holds)
+  CompatibilityGraph const* graph = nullptr;
+  if (options.cost == kCostDefault || options.cost == CompatibilityGraph::GetDefaultCost(rule)) {
+    graph = &GetGraph(rule);
+  }
+
+  return SolveWith(library.GetTracks(), library.GetNames(), graph, bounded);
+}
+
+Mix Engine::SolveGroups(TrackGroups const& groups, SolveOptions const& options) const
+{
+  LOG(kLogInfo) << "Library splits into " << groups.size() << " groups, and no mix can be longer than " << groups.front().bound;
+
+  size_t threads = options.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // A trace can only follow one solve at a time
+  if (options.trace) {
+    threads = 1;
+  }
+  threads = std::min(threads, groups.size());
+
+  std::vector<Mix> mixes(groups.size());
+  std::vector<ParetoArchive> fronts(options.front ? groups.size() : 0);
+  std::vector<DiverseMixes> alternatives;
+  if (options.alternatives) {
+    alternatives.assign(groups.size(), DiverseMixes(options.alternatives->GetCount(), options.alternatives->GetMinDistance()));
+  }
+  std::vector<char> solved(groups.size(), false);
+  std::atomic<size_t> next_group(0);
+  std::atomic<size_t> best_len(0);
+  auto work = [&]()
+  {
+    for (size_t g = next_group++; g < groups.size(); g = next_group++) {
+
+      // Biggest bounds come first, so once a group can't reach the best
+      // length so far, none of the rest can either (though their mixes can
+      // still make the front, or be alternatives)
+      if (groups[g].bound < best_len && !options.front && !options.alternatives) {
+        break;
+      }
+
+      SolveOptions group_options(options);
+      group_options.max_len = std::min(options.max_len, groups[g].bound + 1);
+      if (options.front) {
+        group_options.front = &fronts[g];
+      }
+      if (options.alternatives) {
+        group_options.alternatives = &alternatives[g];
+      }
+      mixes[g] = Solve(groups[g].tracks, group_options);
+      solved[g] = true;
+
+      size_t len = mixes[g].steps.size();
+      size_t prev = best_len;
+      while (len > prev && !best_len.compare_exchange_weak(prev, len)) {
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) {
+    workers.push_back(std::thread(work));
+  }
+  work();
+  for (auto& w : workers) {
+    w.join();
+  }
+  for (auto const& f : fronts) {
+    options.front->Merge(f);
+  }
+  for (auto const& a : alternatives) {
+    options.alternatives->Merge(a);
+  }
+
+  // Longest first, then cheapest, then earliest group, however the threads ran
+  CostAggregate aggregate = options.solver == kSolverBottleneck ? kAggregateMax : options.aggregate;
+  size_t best = 0;
+  for (size_t g = 1; g < groups.size(); ++g) {
+    if (!solved[g]) {
+      continue;
+    }
+    size_t len = mixes[g].steps.size();
+    size_t cur_len = mixes[best].steps.size();
+    if (len > cur_len || (len == cur_len && GetMixCost(mixes[g], aggregate) < GetMixCost(mixes[best], aggregate))) {
+      best = g;
+    }
+  }
+  return mixes[best];
+}
+
+Mix Engine::Solve(std::vector<int> const& subset, SolveOptions const& options) const
+{
+  if (options.class_bpm >= 0) {
+    return SolveClasses(subset, options);
+  }
+
+  Tracks const& all = library.GetTracks();
+
+  // The solvers want track indices to match positions, so number the subset
+  // from zero and map back to library indices afterwards
+  Tracks tracks;
+  std::vector<std::string> names;
+  tracks.reserve(subset.size());
+  names.reserve(subset.size());
+  for (auto idx : subset) {
+    if (idx < 0 || idx >= static_cast<int>(all.size())) {
+      throw "Invalid track index";
+    }
+    tracks.push_back(Track(static_cast<int>(tracks.size()), all[idx].bpm, all[idx].key));
+    names.push_back(library.GetNames()[idx]);
+  }
+
+  ParetoArchive front;
+  DiverseMixes alternatives;
+  SolveOptions subset_options(options);
+  subset_options.warm_start = nullptr;
+  subset_options.front = options.front ? &front : nullptr;
+  if (options.alternatives) {
+    alternatives = DiverseMixes(options.alternatives->GetCount(), options.alternatives->GetMinDistance());
+    subset_options.alternatives = &alternatives;
+  }
+
+  Mix m = SolveWith(tracks, names, nullptr, subset_options);
+  for (auto& s : m.steps) {
+    s.track.idx = subset[s.track.idx];
+  }
+  if (options.front) {
+    for (auto& e : front.GetFront()) {
+      for (auto& idx : e.mix.order) {
+        idx = subset[idx];
+      }
+      options.front->Offer(e.length, e.total, e.worst, e.mix);
+    }
+  }
+  if (options.alternatives) {
+    for (auto& mix : alternatives.GetMixes()) {
+      for (auto& idx : mix.order) {
+        idx = subset[idx];
+      }
+      options.alternatives->Offer(mix.size(), mix.cost, mix);
+    }
+  }
+  return m;
+}
+
+Mix Engine::SolveClasses(std::vector<int> const& subset, SolveOptions const& options) const
+{
+  Tracks const& all = library.GetTracks();
+  Tracks tracks;
+  tracks.reserve(subset.size());
+  for (auto idx : subset) {
+    if (idx < 0 || idx >= static_cast<int>(all.size())) {
+      throw "Invalid track index";
+    }
+    tracks.push_back(all[idx]);
+  }
+
+  TrackClasses classes;
+  classes.Build(tracks, options.class_bpm);
+  LOG(kLogInfo) << "Solving " << tracks.size() << " tracks as " << classes.GetNumClasses() << " classes";
+
+  // The front and alternatives are found among the representatives, and
+  // expanded like the mix itself before they're handed back
+  ParetoArchive front;
+  DiverseMixes alternatives;
+  SolveOptions class_options(options);
+  class_options.class_bpm = -1;
+  class_options.warm_start = nullptr;
+  class_options.front = options.front ? &front : nullptr;
+  if (options.alternatives) {
+    alternatives = DiverseMixes(options.alternatives->GetCount(), options.alternatives->GetMinDistance());
+    class_options.alternatives = &alternatives;
+  }
+
+  Mix m = Solve(classes.GetRepresentatives(), class_options);
+  size_t max_len = options.solver == kSolverExhaustive || options.solver == kSolverBottleneck ? options.max_len : SIZE_MAX;
+  CompatibilityRule rule = options.solver == kSolverExhaustive || options.solver == kSolverHorizon ? kRuleKeyShift : kRuleDistance;
+  CompatibilityGraph const& graph = GetGraph(rule);
+  Mix expanded = classes.Expand(m, all, graph, max_len);
+  if (!options.front && !options.alternatives) {
+    return expanded;
+  }
+
+  // Expanded mixes are priced again the way the solver priced them, which
+  // needs a graph of its own for any other cost model (with the same edges)
+  CompatibilityGraph own_graph;
+  CompatibilityGraph const* priced = &graph;
+  if (options.cost != kCostDefault && options.cost != CompatibilityGraph::GetDefaultCost(rule)) {
+    own_graph.Build(all, rule, options.cost, options.threads);
+    priced = &own_graph;
+  }
+  CostAggregate aggregate = options.solver == kSolverBottleneck ? kAggregateMax : options.aggregate;
+  auto expand = [&](CompactMix const& mix, double& total, double& worst)
+  {
+    Mix full = classes.Expand(mix.Materialize(all), all, graph, max_len);
+    total = 0;
+    worst = 0;
+    for (size_t i = 0; i + 1 < full.steps.size(); ++i) {
+      int node = priced->GetNode(full.steps[i].track.idx, full.steps[i].GetPlayKey());
+      GraphEdge e;
+      if (node >= 0 && priced->GetEdge(all, node, full.steps[i+1].track.idx, e)) {
+        total += e.cost;
+        worst = std::max(worst, e.cost);
+      }
+    }
+    return CompactMix::FromMix(full);
+  };
+
+  double total;
+  double worst;
+  if (options.front) {
+    for (auto const& e : front.GetFront()) {
+      CompactMix mix = expand(e.mix, total, worst);
+      options.front->Offer(mix.size(), total, worst, mix);
+    }
+  }
+  if (options.alternatives) {
+    for (auto const& a : alternatives.GetMixes()) {
+      CompactMix mix = expand(a, total, worst);
+      options.alternatives->Offer(mix.size(), aggregate == kAggregateMax ? worst : total, mix);
+    }
+  }
+  return expanded;
+}
+
+std::vector<Mix> Engine::Partition(size_t parts, SolveOptions const& options) const
+{
+  CompatibilityGraph own_graph;
+  CompatibilityGraph const* graph = &own_graph;
+  if (options.cost == kCostDefault || options.cost == kCostTransition) {
+    graph = &GetGraph(kRuleDistance);
+  } else {
+    own_graph.Build(library.GetTracks(), kRuleDistance, options.cost, options.threads);
+  }
+
+  MixPartitioner partitioner;
+  partitioner.SetTrace(options.trace);
+  return partitioner.Partition(library.GetTracks(), *graph, parts, options.threads);
+}
+
+Suggestions Engine::Suggest(
+  int playing,
+  Key const& play_key,
+  std::vector<bool> const& played,
+  size_t count
+  ) const
+{
+  Suggestions suggestions;
+  neighbors.Query(playing, play_key, played, count, suggestions, kDistThreshold);
+  return suggestions;
+}
+
+Mix Engine::Score(std::vector<int> const& order) const
+{
+  Tracks const& all = library.GetTracks();
+
+  Mix m;
+  for (auto idx : order) {
+    if (idx < 0 || idx >= static_cast<int>(all.size())) {
+      throw "Invalid track index";
+    }
+    MixStep step(all[idx]);
+    if (!m.steps.empty()) {
+      step.SetPlayKey(MixAnt::ChoosePlayKey(m.steps.back().GetPlayKey(), step.track.key));
+      m.steps.back().bpm_end = step.bpm_beg;
+    }
+    m.steps.push_back(step);
+  }
+  m.CalculateDistance();
+  return m;
+}
+
+void Engine::ScoreMany(
+  std::vector<int> const& indices,
+  std::vector<size_t> const& offsets,
+  BatchScorer::Sink const& sink,
+  size_t threads
+  ) const
+{
+  scorer.Score(indices, offsets, sink, threads);
+}
+
+Mix Engine::SolveWith(
+  Tracks const& tracks,
+  std::vector<std::string> const& names,
+  CompatibilityGraph const* graph,
+  SolveOptions const& options
+  ) const
+{
+  switch (options.solver) {
+  case kSolverExhaustive:
+    return SolveExhaustive(tracks, names, graph, options);
+  case kSolverBottleneck:
+    return SolveBottleneck(tracks, graph, options);
+  case kSolverHorizon:
+    return SolveHorizon(tracks, graph, options);
+  default:
+    return SolveAnt(tracks, graph, options);
+  }
+}
+
+// Start at each track and try to get as many tracks into a mix as possible
+// We will exhaustively try to join into each possible next track that is compatible
+// Every start shares the incumbent, so later starts only report real improvements
+Mix Engine::SolveAnt(
+  Tracks const& tracks,
+  CompatibilityGraph const* graph,
+  SolveOptions const& options
+  ) const
+{
+  MixAnt ma;
+  ma.SetGraph(graph);
+  ma.SetCost(options.cost, options.aggregate);
+  ma.SetFront(options.front);
+  ma.SetAlternatives(options.alternatives);
+  ma.Seed(options.seed);
+  ma.SetTrace(options.trace);
+  ma.SetBudget(options.budget);
+  return ma.FindMix(tracks, options.warm_start, options.runs, options.stop_len);
+}
+
+Mix Engine::SolveExhaustive(
+  Tracks const& tracks,
+  std::vector<std::string> const& names,
+  CompatibilityGraph const* graph,
+  SolveOptions const& options
+  ) const
+{
+  using namespace std::chrono;
+  steady_clock::time_point deadline = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(options.budget));
+
+  CompatibilityGraph own_graph;
+  if (!graph) {
+    own_graph.Build(tracks, kRuleKeyShift, options.cost);
+    graph = &own_graph;
+  }
+
+  // Bitsets pay off until the library gets too big for them
+  BitsetSearch bitsets;
+  bool use_bitsets = tracks.size() <= kMaxBitsetTracks;
+  if (use_bitsets) {
+    bitsets.Build(*graph);
+    bitsets.SetFront(options.front);
+    bitsets.SetAlternatives(options.alternatives);
+  }
+
+  CompactMix best;
+  double best_cost = DBL_MAX;
+  std::vector<bool> used(tracks.size());
+  for (size_t i = 0; i < tracks.size() && best.size() < options.stop_len; ++i) {
+    if (options.budget > 0 && steady_clock::now() > deadline) {
+      break;
+    }
+    METRIC_TIME(kTimeSearch);
+    LOG(kLogDebug) << "Starting with " << names[tracks[i].idx];
+
+    int start = graph->GetStartNode(static_cast<int>(i));
+    if (use_bitsets) {
+      bitsets.Search(tracks, start, static_cast<int>(options.max_len), options.stop_len, best, best_cost, options.trace, options.aggregate);
+      continue;
+    }
+
+    CompactMix chosen;
+    int its = 0;
+    Track const& t = tracks[i];
+    used[i] = true;
+    chosen.Push(t.idx, t.key, t.bpm, t.bpm);
+    ChooseTrack(
+      names,
+      tracks,
+      *graph,
+      used,
+      chosen,
+      start,
+      0,
+      best_cost,
+      static_cast<int>(options.max_len),
+      options.stop_len,
+      best,
+      its,
+      options.trace,
+      options.aggregate,
+      options.front
+      );
+    used[i] = false;
+  }
+
+  best.cost = best_cost;
+  return best.Materialize(tracks);
+}
+
+// Some mix is at least as long as a walk along each node's cheapest edge to a
+// track not yet played, so the longest (then least bad) walk from any start
+// is a cheap place for the bottleneck solver to begin
+static void WalkCheapest(
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  size_t max_len,
+  CompactMix& best,
+  double& best_cost
+  )
+{
+  std::vector<bool> used(tracks.size());
+  CompactMix chosen;
+  for (size_t i = 0; i < tracks.size() && best.size() < max_len; ++i) {
+    int node = graph.GetStartNode(static_cast<int>(i));
+    double cost = 0;
+    chosen.Clear();
+    chosen.Push(tracks[i].idx, graph.GetKey(node), tracks[i].bpm, tracks[i].bpm);
+    used[i] = true;
+    while (chosen.size() < max_len) {
+      GraphEdge const* e = graph.EdgesBegin(node);
+      while (e != graph.EdgesEnd(node) && used[graph.GetTrack(e->node)]) {
+        ++e;
+      }
+      if (e == graph.EdgesEnd(node)) {
+        break;
+      }
+      int t = graph.GetTrack(e->node);
+      used[t] = true;
+      chosen.Push(tracks[t].idx, graph.GetKey(e->node), tracks[t].bpm, tracks[t].bpm);
+      cost = std::max(cost, e->cost);
+      node = e->node;
+    }
+    if (chosen.size() > best.size() || (chosen.size() == best.size() && cost < best_cost)) {
+      best = chosen;
+      best_cost = cost;
+    }
+    for (auto t : chosen.order) {
+      used[t] = false;
+    }
+  }
+}
+
+// Finds how long a mix can get first, then binary searches the graph's edge
+// costs for the smallest worst transition that still allows a mix that long
+// Lengths are searched between a greedy walk (which some mix always reaches)
+// and the longest path the graph's components allow (which none can beat)
+// Each check is an exact search over the edges no dearer than a threshold,
+// which stops as soon as it finds a mix long enough. The bitsets are built
+// once, over the whole graph, and every check just ignores the dearer edges
+Mix Engine::SolveBottleneck(
+  Tracks const& tracks,
+  CompatibilityGraph const* graph,
+  SolveOptions const& options
+  ) const
+{
+  if (tracks.size() > kMaxBitsetTracks) {
+    throw "Too many tracks for the bottleneck solver";
+  }
+  if (tracks.empty()) {
+    return Mix();
+  }
+
+  using namespace std::chrono;
+  steady_clock::time_point deadline = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(options.budget));
+
+  // A shared graph comes with its components
+  CompatibilityGraph own_graph;
+  GraphComponents own_parts;
+  GraphComponents const* parts = &own_parts;
+  if (graph) {
+    parts = &GetComponents(kRuleDistance);
+  } else {
+    own_graph.Build(tracks, kRuleDistance, options.cost);
+    own_parts.Build(own_graph);
+    graph = &own_graph;
+  }
+
+  BitsetSearch bitsets;
+  bitsets.Build(*graph);
+  bitsets.SetFront(options.front);
+  bitsets.SetAlternatives(options.alternatives);
+  bitsets.SetPatience(0);
+  if (options.budget > 0) {
+    bitsets.SetDeadline(deadline);
+  }
+
+  // Is there a mix of len tracks with no transition over max_cost?
+  // Every check is exact, so it can take a while, and one that runs out of
+  // budget ends the solve with the best mix so far
+  CompactMix found;
+  double found_cost = DBL_MAX;
+  auto find = [&](size_t len, double max_cost)
+  {
+    METRIC_TIME(kTimeSearch);
+    bitsets.SetMaxCost(max_cost);
+    found.Clear();
+    found_cost = DBL_MAX;
+    for (size_t i = 0; i < tracks.size() && found.size() < len && !bitsets.TimedOut(); ++i) {
+      int start = graph->GetStartNode(static_cast<int>(i));
+      bitsets.Search(tracks, start, static_cast<int>(len + 1), len, found, found_cost, nullptr, kAggregateMax);
+    }
+    return found.size() >= len;
+  };
+  auto out_of_time = [&]()
+  {
+    return bitsets.TimedOut() || (options.budget > 0 && steady_clock::now() > deadline);
+  };
+
+  // The searches stop one short of max_len
+  size_t max_len = std::min(options.max_len > 0 ? options.max_len - 1 : 0, options.stop_len);
+  max_len = std::max<size_t>(max_len, 1);
+
+  CompactMix best;
+  double best_cost = DBL_MAX;
+  WalkCheapest(tracks, *graph, max_len, best, best_cost);
+  if (options.trace) {
+    options.trace->Record(best.size(), best_cost);
+  }
+
+  // Any mix longer than the walk is as long as it gets with every edge
+  size_t lo_len = best.size();
+  size_t hi_len = std::max(lo_len, std::min(max_len, parts->GetBound()));
+  while (lo_len < hi_len && !out_of_time()) {
+    size_t mid = lo_len + (hi_len - lo_len + 1) / 2;
+    bool ok = find(mid, DBL_MAX);
+    if (out_of_time() && !ok) {
+      break;
+    }
+    if (ok) {
+      best = found;
+      best_cost = found_cost;
+      lo_len = mid;
+      LOG(kLogInfo) << "Mix of length " << mid << " with no transition over " << best_cost;
+      if (options.trace) {
+        options.trace->Record(best.size(), best_cost);
+      }
+    } else {
+      hi_len = mid - 1;
+    }
+  }
+  size_t len = best.size();
+
+  // Edges up to the best's worst transition are known to allow a mix of len
+  std::vector<double> costs = graph->GetCosts();
+  size_t lo = 0;
+  size_t hi = std::lower_bound(costs.begin(), costs.end(), best_cost) - costs.begin();
+  while (lo < hi) {
+    if (out_of_time()) {
+      LOG(kLogDebug) << "Out of time with worst transitions between " << costs[lo] << " and " << best_cost;
+      break;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    bool ok = find(len, costs[mid]);
+    if (out_of_time() && !ok) {
+      break;
+    }
+    if (ok) {
+      best = found;
+      best_cost = found_cost;
+      hi = std::lower_bound(costs.begin(), costs.end(), best_cost) - costs.begin();
+      LOG(kLogInfo) << "Mix of length " << len << " with no transition over " << best_cost;
+      if (options.trace) {
+        options.trace->Record(len, best_cost);
+      }
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  best.cost = best_cost;
+  return best.Materialize(tracks);
+}
+
+// Plans from wherever the longest mix could start, until the mix is stop_len
+// long or nothing more fits
+Mix Engine::SolveHorizon(
+  Tracks const& tracks,
+  CompatibilityGraph const* graph,
+  SolveOptions const& options
+  ) const
+{
+  if (tracks.size() > kMaxBitsetTracks) {
+    throw "Too many tracks for the horizon planner";
+  }
+  if (tracks.empty()) {
+    return Mix();
+  }
+
+  // A shared graph comes with its components, and is only thinned
+  // Otherwise the planner builds just the edges it follows, and plans start
+  // from its components
+  HorizonPlanner planner;
+  GraphComponents own_parts;
+  GraphComponents const* parts = &own_parts;
+  if (graph) {
+    planner.Build(*graph);
+    parts = &GetComponents(kRuleKeyShift);
+  } else {
+    planner.Build(tracks, options.cost, options.threads);
+    own_parts.Build(planner.GetGraph());
+    graph = &planner.GetGraph();
+  }
+
+  int start = HorizonPlanner::FindStart(tracks, *graph, *parts);
+  return planner.Plan(tracks, start, options.window, options.commit, options.stop_len, options.budget, options.trace, options.aggregate);
+}
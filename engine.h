@@ -0,0 +1,203 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "components.h"
+#include "costs.h"
+#include "diverse.h"
+#include "graph.h"
+#include "library.h"
+#include "mix.h"
+#include "mixant.h"
+#include "neighbors.h"
+#include "pareto.h"
+#include "trace.h"
+
+enum SolverType
+{
+  kSolverAnt,
+  kSolverExhaustive,
+
+  // Smallest worst transition for the longest mix there is (over the same
+  // graph as the ant solver)
+  kSolverBottleneck,
+
+  // The exhaustive search a window at a time (see HorizonPlanner), for
+  // mixes far longer than max_len
+  kSolverHorizon
+};
+
+struct SolveOptions
+{
+  SolveOptions();
+
+  SolverType solver;
+
+  // Random restarts for the ant solver
+  int runs;
+
+  // Longest mix the exhaustive and bottleneck solvers will build
+  size_t max_len;
+
+  // Tracks the horizon planner looks ahead, and how many of those it keeps
+  // before looking again
+  size_t window;
+  size_t commit;
+
+  // Either solver stops as soon as it has a mix this long
+  size_t stop_len;
+
+  // Seconds either solver may spend before returning its best so far
+  // (0 for no limit)
+  double budget;
+
+  // Seeds the ant solver's random engine, so a solve can be repeated
+  unsigned long seed;
+
+  // Optional mix to improve on (ant solver on the whole library only)
+  Mix const* warm_start;
+
+  // Optional trace of the solver's improvements
+  ConvergenceTrace* trace;
+
+  // Optional archive of every mix the solver comes across that no other
+  // beats on length, total cost and worst transition at once, with track
+  // indices into the library (not filled by the horizon planner)
+  ParetoArchive* front;
+
+  // Optional set of the best mixes the solver comes across that are all
+  // different enough from each other (see DiverseMixes), with track indices
+  // into the library (not filled by the horizon planner, or by the
+  // exhaustive search over libraries too big for bitsets)
+  DiverseMixes* alternatives;
+
+  // Threads for solving separate groups of tracks at once (0 for one per
+  // hardware thread)
+  size_t threads;
+
+  // Tracks with the same key and tempos within this many BPM are solved as
+  // one (see TrackClasses), and put back together afterwards (in the front
+  // and alternatives too)
+  // Negative (the default) solves every track on its own
+  double class_bpm;
+
+  // How transitions are priced (by default, as each solver always has), and
+  // how they add up to the cost of a mix (the bottleneck solver always takes
+  // the worst)
+  CostModel     cost;
+  CostAggregate aggregate;
+};
+
+// Everything needed to build mixes from one library
+// Loading builds the indices, and after that Solve and Score only read them
+// (apart from building each compatibility graph once, under a lock), so any
+// number of threads can solve on the same Engine at once
+// Solvers keep all of their state (including random engines) per call
+class Engine
+{
+public:
+
+  Engine();
+
+  void Load(std::string const& path);
+
+  // Picks up changes to the loaded file
+  // The library and the neighbor index only touch the tracks that changed,
+  // but the scorer's per-track arrays are filled again (a linear copy) and
+  // each graph is built from scratch the next time a solver asks for it
+  // Not safe to call while other threads are solving
+  bool Poll();
+
+  Library const& GetLibrary() const;
+
+  // Solves for the whole library, or just the given track indices
+  // A library that splits into groups no mix can join up (see
+  // GraphComponents) has each group solved separately, and no solve looks
+  // for a mix longer than the graph allows
+  Mix Solve(SolveOptions const& options) const;
+  Mix Solve(std::vector<int> const& subset, SolveOptions const& options) const;
+
+  // Splits the whole library into parts mixes that share no tracks (see
+  // MixPartitioner), on options.threads threads and with options.cost
+  std::vector<Mix> Partition(size_t parts, SolveOptions const& options) const;
+
+  // Best count tracks to play after playing (in play_key), skipping played
+  // Only compatible tracks (costing less than kDistThreshold) are suggested
+  Suggestions Suggest(
+    int playing,
+    Key const& play_key,
+    std::vector<bool> const& played,
+    size_t count
+    ) const;
+
+  // Builds a mix that plays the given tracks in order, picking compatible play
+  // keys and scoring every transition
+  Mix Score(std::vector<int> const& order) const;
+
+  // Scores many orderings at once (see BatchScorer)
+  void ScoreMany(
+    std::vector<int> const& indices,
+    std::vector<size_t> const& offsets,
+    BatchScorer::Sink const& sink,
+    size_t threads = 0
+    ) const;
+
+protected:
+
+  // Solvers build their own graph for tracks if they aren't given one
+  Mix SolveWith(
+    Tracks const& tracks,
+    std::vector<std::string> const& names,
+    CompatibilityGraph const* graph,
+    SolveOptions const& options
+    ) const;
+  Mix SolveAnt(
+    Tracks const& tracks,
+    CompatibilityGraph const* graph,
+    SolveOptions const& options
+    ) const;
+  Mix SolveExhaustive(
+    Tracks const& tracks,
+    std::vector<std::string> const& names,
+    CompatibilityGraph const* graph,
+    SolveOptions const& options
+    ) const;
+  Mix SolveBottleneck(
+    Tracks const& tracks,
+    CompatibilityGraph const* graph,
+    SolveOptions const& options
+    ) const;
+  Mix SolveHorizon(
+    Tracks const& tracks,
+    CompatibilityGraph const* graph,
+    SolveOptions const& options
+    ) const;
+
+  Mix SolveGroups(TrackGroups const& groups, SolveOptions const& options) const;
+  Mix SolveClasses(std::vector<int> const& subset, SolveOptions const& options) const;
+
+  // With update, the neighbor index is brought up to date in place rather
+  // than built afresh
+  void BuildIndices(bool update);
+
+  // The graphs can get big, so each is only built (and split into
+  // components) when a solver first asks
+  void                      BuildGraph(CompatibilityRule rule) const;
+  CompatibilityGraph const& GetGraph(CompatibilityRule rule) const;
+  GraphComponents const&    GetComponents(CompatibilityRule rule) const;
+
+  Library       library;
+  NeighborIndex neighbors;
+  BatchScorer   scorer;
+
+  mutable std::mutex         graphs_mutex;
+  mutable bool               graphs_built[2];
+  mutable CompatibilityGraph graphs[2];
+  mutable GraphComponents    components[2];
+};
+
+#endif
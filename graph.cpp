@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+#include "graph.h"
+#include "metrics.h"
+#include "mixant.h"
+#include "search.h"
+#include "transition.h"
+
+// Tracks each thread takes at a time while building
+static const int kChunkTracks = 256;
+
+// Slack on the tempo window, so rounding never drops an edge the rule allows
+static const double kWindowSlack = 1e-9;
+
+CompatibilityGraph::CompatibilityGraph() : rule(kRuleDistance), cost(kCostTransition), max_shift(0), width(1)
+{
+  offsets.assign(1, 0);
+}
+
+void CompatibilityGraph::Build(Tracks const& tracks, CompatibilityRule rule, size_t threads)
+{
+  Build(tracks, rule, kCostDefault, threads);
+}
+
+void CompatibilityGraph::Build(
+  Tracks const& tracks,
+  CompatibilityRule rule,
+  CostModel cost,
+  size_t threads,
+  size_t max_degree
+  )
+{
+  METRIC_TIME(kTimeDistances);
+
+  typedef void (CompatibilityGraph::*NodeBuilder)(
+    Tracks const&,
+    std::vector<int> const&,
+    int,
+    int,
+    size_t,
+    std::vector<size_t>&,
+    std::vector<GraphEdge>&
+    ) const;
+
+  // Indexed by CostModel
+  static NodeBuilder const kBuilders[] = {
+    nullptr,
+    &CompatibilityGraph::BuildNodes<TransitionCost>,
+    &CompatibilityGraph::BuildNodes<KeyShiftCost>
+  };
+
+  this->cost = cost == kCostDefault ? GetDefaultCost(rule) : cost;
+  NodeBuilder build_nodes = kBuilders[this->cost];
+
+  // A transition costs at least its transposition, so the distance threshold
+  // limits how far the next track can ever be shifted
+  this->rule = rule;
+  max_shift = rule == kRuleDistance ? static_cast<int>(ceil(kDistThreshold)) - 1 : kKeyShiftThresh;
+  width = 2 * max_shift + 1;
+
+  int num_tracks = static_cast<int>(tracks.size());
+  track_keys.resize(tracks.size());
+  node_keys.resize(tracks.size() * width);
+  for (int i = 0; i < num_tracks; ++i) {
+    track_keys[i] = static_cast<unsigned char>(Key::GetKeyIndex(tracks[i].key));
+    for (int s = 0; s < width; ++s) {
+      node_keys[i * width + s] = static_cast<unsigned char>(Key::GetKeyIndex(tracks[i].key + (s - max_shift)));
+    }
+  }
+
+  // Neighbours can only be so far away in tempo, so each track only has to
+  // look through a window of the tracks sorted by tempo
+  std::vector<int> by_tempo(tracks.size());
+  std::iota(by_tempo.begin(), by_tempo.end(), 0);
+  std::sort(by_tempo.begin(), by_tempo.end(), [&](int a, int b)
+  {
+    return tracks[a].log_bpm < tracks[b].log_bpm;
+  });
+
+  // Each chunk of tracks is built on its own, then they're joined in order
+  size_t num_chunks = (tracks.size() + kChunkTracks - 1) / kChunkTracks;
+  std::vector<std::vector<size_t> >    chunk_counts(num_chunks);
+  std::vector<std::vector<GraphEdge> > chunk_edges(num_chunks);
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, num_chunks);
+
+  std::atomic<size_t> next_chunk(0);
+  auto work = [&]()
+  {
+    for (size_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+      int beg = static_cast<int>(c) * kChunkTracks;
+      int end = std::min(beg + kChunkTracks, num_tracks);
+      (this->*build_nodes)(tracks, by_tempo, beg, end, max_degree, chunk_counts[c], chunk_edges[c]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) {
+    workers.push_back(std::thread(work));
+  }
+  work();
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  size_t num_edges = 0;
+  for (auto const& e : chunk_edges) {
+    num_edges += e.size();
+  }
+
+  offsets.assign(1, 0);
+  offsets.reserve(node_keys.size() + 1);
+  edges.clear();
+  edges.reserve(num_edges);
+  for (size_t c = 0; c < num_chunks; ++c) {
+    for (auto n : chunk_counts[c]) {
+      offsets.push_back(offsets.back() + n);
+    }
+    edges.insert(edges.end(), chunk_edges[c].begin(), chunk_edges[c].end());
+    std::vector<GraphEdge>().swap(chunk_edges[c]);
+  }
+}
+
+template <typename Cost>
+void CompatibilityGraph::BuildNodes(
+  Tracks const& tracks,
+  std::vector<int> const& by_tempo,
+  int beg,
+  int end,
+  size_t max_degree,
+  std::vector<size_t>& counts,
+  std::vector<GraphEdge>& found
+  ) const
+{
+  // Cheapest first, then by node so the order never depends on threads
+  auto cheaper = [](GraphEdge const& a, GraphEdge const& b)
+  {
+    return a.cost < b.cost || (a.cost == b.cost && a.node < b.node);
+  };
+
+  Keys const& keys = Key::GetKeys();
+  double window = (rule == kRuleDistance ? kDistThreshold : Track::LogBPM(1 + kBPMThresh)) + kWindowSlack;
+
+  for (int t = beg; t < end; ++t) {
+    Track const& from = tracks[t];
+    auto lo = std::lower_bound(by_tempo.begin(), by_tempo.end(), from.log_bpm - window, [&](int a, double v)
+    {
+      return tracks[a].log_bpm < v;
+    });
+    auto hi = std::upper_bound(lo, by_tempo.end(), from.log_bpm + window, [&](double v, int a)
+    {
+      return v < tracks[a].log_bpm;
+    });
+
+    for (int s = 0; s < width; ++s) {
+      int from_key = node_keys[t * width + s];
+      Transition const* transitions = TransitionTable::GetRow(from_key);
+      Track played(from.idx, from.bpm, keys[from_key]);
+
+      size_t first = found.size();
+      for (auto it = lo; it != hi; ++it) {
+        int u = *it;
+        if (u == t) {
+          continue;
+        }
+        GraphEdge e;
+        if (MakeEdge<Cost>(from, played, tracks[u], u, transitions[track_keys[u]], e)) {
+          found.push_back(e);
+        }
+      }
+
+      if (found.size() - first > max_degree) {
+        std::partial_sort(found.begin() + first, found.begin() + first + max_degree, found.end(), cheaper);
+        found.resize(first + max_degree);
+      } else {
+        std::sort(found.begin() + first, found.end(), cheaper);
+      }
+      counts.push_back(found.size() - first);
+    }
+  }
+}
+
+template <typename Cost>
+bool CompatibilityGraph::MakeEdge(
+  Track const& from,
+  Track const& played,
+  Track const& to,
+  int u,
+  Transition const& next,
+  GraphEdge& edge
+  ) const
+{
+  // The rule decides whether there's an edge, and the policy its cost
+  int shift;
+  if (rule == kRuleDistance) {
+    if (TransitionCost::Edge(from, to, next) >= kDistThreshold) {
+      return false;
+    }
+    shift = next.tuning;
+  } else {
+    Key adjusted;
+    double rule_cost;
+    if (!AreCompatibleTracks(played, to, kBPMThresh, kKeyShiftThresh, adjusted, rule_cost)) {
+      return false;
+    }
+    shift = next.shift;
+  }
+
+  edge.cost = Cost::Edge(from, to, next);
+  edge.node = u * width + shift + max_shift;
+  return true;
+}
+
+bool CompatibilityGraph::GetEdge(Tracks const& tracks, int node, int track, GraphEdge& edge) const
+{
+  typedef bool (CompatibilityGraph::*EdgeMaker)(
+    Track const&,
+    Track const&,
+    Track const&,
+    int,
+    Transition const&,
+    GraphEdge&
+    ) const;
+
+  // Indexed by CostModel
+  static EdgeMaker const kMakers[] = {
+    nullptr,
+    &CompatibilityGraph::MakeEdge<TransitionCost>,
+    &CompatibilityGraph::MakeEdge<KeyShiftCost>
+  };
+
+  int t = GetTrack(node);
+  if (t == track) {
+    return false;
+  }
+  Track const& from = tracks[t];
+  Track played(from.idx, from.bpm, GetKey(node));
+  Transition const& next = TransitionTable::GetRow(node_keys[node])[track_keys[track]];
+  return (this->*kMakers[cost])(from, played, tracks[track], track, next, edge);
+}
+
+template <typename Cut>
+void CompatibilityGraph::CopyEdges(CompatibilityGraph const& graph, Cut cut)
+{
+  rule = graph.rule;
+  cost = graph.cost;
+  max_shift = graph.max_shift;
+  width = graph.width;
+  track_keys = graph.track_keys;
+  node_keys = graph.node_keys;
+
+  offsets.assign(1, 0);
+  offsets.reserve(graph.offsets.size());
+  edges.clear();
+  for (size_t n = 0; n + 1 < graph.offsets.size(); ++n) {
+    GraphEdge const* beg = graph.edges.data() + graph.offsets[n];
+    GraphEdge const* end = graph.edges.data() + graph.offsets[n+1];
+    edges.insert(edges.end(), beg, cut(beg, end));
+    offsets.push_back(edges.size());
+  }
+}
+
+void CompatibilityGraph::Restrict(CompatibilityGraph const& graph, double max_cost)
+{
+  CopyEdges(graph, [=](GraphEdge const* beg, GraphEdge const* end)
+  {
+    return std::upper_bound(beg, end, max_cost, [](double c, GraphEdge const& e)
+    {
+      return c < e.cost;
+    });
+  });
+}
+
+void CompatibilityGraph::Thin(CompatibilityGraph const& graph, size_t max_degree)
+{
+  CopyEdges(graph, [=](GraphEdge const* beg, GraphEdge const* end)
+  {
+    return beg + std::min<size_t>(end - beg, max_degree);
+  });
+}
+
+std::vector<double> CompatibilityGraph::GetCosts() const
+{
+  std::vector<double> costs;
+  costs.reserve(edges.size());
+  for (auto const& e : edges) {
+    costs.push_back(e.cost);
+  }
+  std::sort(costs.begin(), costs.end());
+  costs.erase(std::unique(costs.begin(), costs.end()), costs.end());
+  return costs;
+}
+
+void CompatibilityGraph::FindLeadIns(std::vector<size_t>& offsets, std::vector<GraphEdge>& lead_ins) const
+{
+  int tracks = static_cast<int>(GetNumTracks());
+
+  // Count each track's lead ins first, so they can go straight into place
+  offsets.assign(tracks + 1, 0);
+  for (int t = 0; t < tracks; ++t) {
+    int from = GetStartNode(t);
+    for (auto e = EdgesBegin(from); e != EdgesEnd(from); ++e) {
+      if (e->node == GetStartNode(GetTrack(e->node))) {
+        ++offsets[GetTrack(e->node) + 1];
+      }
+    }
+  }
+  for (int t = 0; t < tracks; ++t) {
+    offsets[t+1] += offsets[t];
+  }
+
+  lead_ins.resize(offsets.back());
+  std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+  for (int t = 0; t < tracks; ++t) {
+    int from = GetStartNode(t);
+    for (auto e = EdgesBegin(from); e != EdgesEnd(from); ++e) {
+      if (e->node == GetStartNode(GetTrack(e->node))) {
+        GraphEdge lead_in = { e->cost, from };
+        lead_ins[fill[GetTrack(e->node)]++] = lead_in;
+      }
+    }
+  }
+  for (int t = 0; t < tracks; ++t) {
+    std::stable_sort(lead_ins.begin() + offsets[t], lead_ins.begin() + offsets[t+1], [](GraphEdge const& a, GraphEdge const& b)
+    {
+      return a.cost < b.cost;
+    });
+  }
+}
+
+int CompatibilityGraph::GetNode(int track, Key const& key) const
+{
+  int key_idx = Key::GetKeyIndex(key);
+  for (int s = 0; s < width; ++s) {
+    if (node_keys[track * width + s] == key_idx) {
+      return track * width + s;
+    }
+  }
+  return -1;
+}
+
+int CompatibilityGraph::GetStartNode(int track) const
+{
+  return track * width + max_shift;
+}
+
+Key const& CompatibilityGraph::GetKey(int node) const
+{
+  return Key::GetKeys()[node_keys[node]];
+}
+
+CostModel CompatibilityGraph::GetDefaultCost(CompatibilityRule rule)
+{
+  return rule == kRuleDistance ? kCostTransition : kCostKeyShift;
+}
+
+CompatibilityRule CompatibilityGraph::GetRule() const
+{
+  return rule;
+}
+
+CostModel CompatibilityGraph::GetCostModel() const
+{
+  return cost;
+}
+
+int CompatibilityGraph::GetMaxShift() const
+{
+  return max_shift;
+}
+
+size_t CompatibilityGraph::GetNumTracks() const
+{
+  return node_keys.size() / width;
+}
+
+size_t CompatibilityGraph::GetNumNodes() const
+{
+  return node_keys.size();
+}
+
+size_t CompatibilityGraph::GetNumEdges() const
+{
+  return edges.size();
+}
@@ -0,0 +1,157 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "costs.h"
+#include "track.h"
+
+// Which transitions count as compatible
+enum CompatibilityRule
+{
+  // Transition cost under kDistThreshold, with the next track played in the
+  // key MixAnt::ChoosePlayKey picks (as MixAnt::FindMix)
+  kRuleDistance,
+
+  // AreCompatibleTracks with kBPMThresh and kKeyShiftThresh (as ChooseTrack)
+  kRuleKeyShift
+};
+
+struct GraphEdge
+{
+  double cost;
+  int    node;
+};
+
+// Every compatible transition in a set of tracks, worked out once
+// A node is a track playing in a particular key (its own key shifted by up to
+// GetMaxShift semitones, since no compatible transition shifts further), so
+// the previous key a rule depends on is part of where an edge starts
+// Edges are stored CSR style: one array of edges, with each node's edges (its
+// neighbours, cheapest first) in one run, so memory goes with the number of
+// compatible transitions rather than the number of track pairs
+class CompatibilityGraph
+{
+public:
+
+  CompatibilityGraph();
+
+  // Zero threads means one per hardware thread
+  // Which transitions are edges only depends on the rule, while their costs
+  // come from the cost model (the rule's own by default)
+  // Only each node's max_degree cheapest edges are kept, as Thin would, but
+  // without ever holding the rest
+  void Build(Tracks const& tracks, CompatibilityRule rule, size_t threads = 0);
+  void Build(
+    Tracks const& tracks,
+    CompatibilityRule rule,
+    CostModel cost,
+    size_t threads = 0,
+    size_t max_degree = SIZE_MAX
+    );
+
+  // Copy of graph with only the edges costing no more than max_cost
+  // Each node's edges are cheapest first, so this just cuts every run short
+  void Restrict(CompatibilityGraph const& graph, double max_cost);
+
+  // Copy of graph with only each node's max_degree cheapest edges, so a
+  // search's work per step stops growing with the library
+  void Thin(CompatibilityGraph const& graph, size_t max_degree);
+
+  // Every distinct edge cost, cheapest first
+  std::vector<double> GetCosts() const;
+
+  // Edges run backwards, for growing a mix at its head: for each track (in
+  // offsets' runs, cheapest first), the edges into it in its own key from
+  // other tracks in theirs, with node the track they come from in its own key
+  // and cost still that of playing forwards into the track
+  void FindLeadIns(std::vector<size_t>& offsets, std::vector<GraphEdge>& lead_ins) const;
+
+  // Works out the edge from node to track afresh, so it's there even if
+  // max_degree left it out (false if the rule allows none)
+  // tracks must be the ones the graph was built from
+  bool GetEdge(Tracks const& tracks, int node, int track, GraphEdge& edge) const;
+
+  // The cost model a rule uses unless told otherwise
+  static CostModel GetDefaultCost(CompatibilityRule rule);
+
+  // Node for a track played in a key (-1 if no transition ever plays it there)
+  int GetNode(int track, Key const& key) const;
+
+  // Node for a track in its own key, for starting a mix
+  int GetStartNode(int track) const;
+
+  int GetTrack(int node) const
+  {
+    return node / width;
+  }
+
+  Key const& GetKey(int node) const;
+
+  GraphEdge const* EdgesBegin(int node) const
+  {
+    return edges.data() + offsets[node];
+  }
+
+  GraphEdge const* EdgesEnd(int node) const
+  {
+    return edges.data() + offsets[node+1];
+  }
+
+  size_t GetDegree(int node) const
+  {
+    return offsets[node+1] - offsets[node];
+  }
+
+  CompatibilityRule GetRule() const;
+  CostModel         GetCostModel() const;
+  int               GetMaxShift() const;
+  size_t            GetNumTracks() const;
+  size_t            GetNumNodes() const;
+  size_t            GetNumEdges() const;
+
+protected:
+
+  // Copies graph, keeping the edges from the start of each node's run up to
+  // wherever cut says
+  template <typename Cut>
+  void CopyEdges(CompatibilityGraph const& graph, Cut cut);
+
+  template <typename Cost>
+  void BuildNodes(
+    Tracks const& tracks,
+    std::vector<int> const& by_tempo,
+    int beg,
+    int end,
+    size_t max_degree,
+    std::vector<size_t>& counts,
+    std::vector<GraphEdge>& found
+    ) const;
+
+  // The edge from a track (played as played) to track u, if the rule allows
+  // one, with next the transition from played's key to u's
+  template <typename Cost>
+  bool MakeEdge(
+    Track const& from,
+    Track const& played,
+    Track const& to,
+    int u,
+    Transition const& next,
+    GraphEdge& edge
+    ) const;
+
+  CompatibilityRule rule;
+  CostModel         cost;
+  int               max_shift;
+  int               width;
+
+  // Key index of each track, and of each node
+  std::vector<unsigned char> track_keys;
+  std::vector<unsigned char> node_keys;
+
+  std::vector<size_t>    offsets;
+  std::vector<GraphEdge> edges;
+};
+
+#endif
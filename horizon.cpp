@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+#include "compact.h"
+#include "horizon.h"
+#include "logger.h"
+#include "metrics.h"
+
+void HorizonPlanner::Build(CompatibilityGraph const& graph)
+{
+  near.Thin(graph, kHorizonDegree);
+  search.Build(near);
+  search.SetPatience(kHorizonPatience);
+  search.SetProgressLevel(kLogDebug);
+}
+
+void HorizonPlanner::Build(Tracks const& tracks, CostModel cost, size_t threads)
+{
+  near.Build(tracks, kRuleKeyShift, cost, threads, kHorizonDegree);
+  search.Build(near);
+  search.SetPatience(kHorizonPatience);
+  search.SetProgressLevel(kLogDebug);
+}
+
+CompatibilityGraph const& HorizonPlanner::GetGraph() const
+{
+  return near;
+}
+
+Mix HorizonPlanner::Plan(
+  Tracks const& tracks,
+  int start_node,
+  size_t window,
+  size_t commit,
+  size_t max_len,
+  double budget,
+  ConvergenceTrace* trace,
+  CostAggregate aggregate
+  )
+{
+  using namespace std::chrono;
+  steady_clock::time_point deadline = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(budget));
+
+  window = std::max<size_t>(window, 1);
+  commit = std::max<size_t>(std::min(commit, window), 1);
+  auto add = aggregate == kAggregateMax ? &MaxCost::Add : &SumCost::Add;
+
+  int start = near.GetTrack(start_node);
+  BitsetSearch::FillRemaining(tracks.size(), start, remaining);
+
+  CompactMix mix;
+  mix.Push(tracks[start].idx, near.GetKey(start_node), tracks[start].bpm, tracks[start].bpm);
+  double cost = 0;
+
+  // What's left of the last window after the tracks we kept, starting from
+  // the end of the mix, with its edges
+  CompactMix rest(mix);
+  std::vector<double> rest_costs;
+
+  std::vector<int> nodes;
+  std::vector<double> costs;
+  int node = start_node;
+  while (mix.size() < max_len) {
+    if (budget > 0 && steady_clock::now() > deadline) {
+      LOG(kLogDebug) << "Out of time with a mix of length " << mix.size();
+      break;
+    }
+
+    // The rest of the last window is already a plan for this one, so the
+    // search only has to beat it
+    size_t len = std::min(window, max_len - mix.size());
+    CompactMix best(rest);
+    while (best.size() > len + 1) {
+      best.Pop();
+    }
+    double best_cost = 0;
+    for (size_t i = 1; i < best.size(); ++i) {
+      best_cost = add(best_cost, rest_costs[i-1]);
+    }
+
+    // The search stops one short of its max_len, as ChooseTrack does
+    search.Search(tracks, remaining, node, static_cast<int>(len + 2), SIZE_MAX, best, best_cost, nullptr, aggregate);
+
+    // Walk the window's edges again for the nodes and costs we stop at
+    nodes.assign(1, node);
+    costs.clear();
+    for (size_t i = 1; i < best.size(); ++i) {
+      GraphEdge const* e = FindEdge(nodes.back(), best.order[i]);
+      nodes.push_back(e->node);
+      costs.push_back(e->cost);
+    }
+
+    // Every nearby track has been played, so carry on through the cheapest
+    // transition left anywhere
+    if (best.size() < 2) {
+      GraphEdge e;
+      if (!FindRemaining(tracks, node, e)) {
+        break;
+      }
+      int t = near.GetTrack(e.node);
+      best.Push(tracks[t].idx, near.GetKey(e.node), tracks[t].bpm, tracks[t].bpm);
+      nodes.push_back(e.node);
+      costs.push_back(e.cost);
+    }
+
+    size_t keep = std::min(commit, best.size() - 1);
+    for (size_t i = 1; i <= keep; ++i) {
+      int t = best.order[i];
+      mix.Push(tracks[t].idx, best.GetPlayKey(i), tracks[t].bpm, tracks[t].bpm);
+      BitsetSearch::Remove(t, remaining);
+      cost = add(cost, costs[i-1]);
+    }
+    node = nodes[keep];
+
+    rest.Clear();
+    for (size_t i = keep; i < best.size(); ++i) {
+      int t = best.order[i];
+      rest.Push(tracks[t].idx, best.GetPlayKey(i), tracks[t].bpm, tracks[t].bpm);
+    }
+    rest_costs.assign(costs.begin() + keep, costs.end());
+
+    METRIC_IMPROVEMENT(mix.size(), cost);
+    if (trace) {
+      trace->Record(mix.size(), cost);
+    }
+  }
+
+  LOG(kLogInfo) << "Planned a mix of length " << mix.size() << " with total distance " << cost;
+  mix.cost = cost;
+  return mix.Materialize(tracks);
+}
+
+int HorizonPlanner::FindStart(
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  GraphComponents const& parts
+  )
+{
+  int start = -1;
+  size_t longest = 0;
+  for (int t = 0; t < static_cast<int>(tracks.size()); ++t) {
+    size_t len = parts.GetLongestFrom(parts.GetComponent(graph.GetStartNode(t)));
+    if (start < 0 || len > longest || (len == longest && tracks[t].bpm < tracks[start].bpm)) {
+      start = t;
+      longest = len;
+    }
+  }
+  return graph.GetStartNode(start);
+}
+
+GraphEdge const* HorizonPlanner::FindEdge(int node, int track) const
+{
+  // A node has at most one edge to each track
+  for (auto e = near.EdgesBegin(node); e != near.EdgesEnd(node); ++e) {
+    if (near.GetTrack(e->node) == track) {
+      return e;
+    }
+  }
+  return nullptr;
+}
+
+bool HorizonPlanner::FindRemaining(Tracks const& tracks, int node, GraphEdge& edge) const
+{
+  // Edges are cheapest first, and the thinned graph kept each node's
+  // cheapest, so any track left among them is the cheapest anywhere
+  for (auto e = near.EdgesBegin(node); e != near.EdgesEnd(node); ++e) {
+    if (BitsetSearch::Has(near.GetTrack(e->node), remaining)) {
+      edge = *e;
+      return true;
+    }
+  }
+
+  // Otherwise every track left has to be looked at, in the same order the
+  // graph sorts its edges
+  bool found = false;
+  for (int t = 0; t < static_cast<int>(tracks.size()); ++t) {
+    GraphEdge e;
+    if (!BitsetSearch::Has(t, remaining) || !near.GetEdge(tracks, node, t, e)) {
+      continue;
+    }
+    if (!found || e.cost < edge.cost || (e.cost == edge.cost && e.node < edge.node)) {
+      edge = e;
+      found = true;
+    }
+  }
+  return found;
+}
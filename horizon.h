@@ -0,0 +1,90 @@
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#include <vector>
+
+#include "bitsearch.h"
+#include "components.h"
+#include "costs.h"
+#include "graph.h"
+#include "mix.h"
+#include "trace.h"
+#include "track.h"
+
+// Tracks each step plans ahead, and how many of them it keeps
+static const size_t kHorizonWindow = 6;
+static const size_t kHorizonCommit = 3;
+
+// Iterations without improvement each window's search gets before it settles
+static const int kHorizonPatience = 20000;
+
+// Cheapest edges out of each node the window searches follow
+static const size_t kHorizonDegree = 32;
+
+// Plans mixes far longer than one exhaustive search could manage (whole
+// multi-hour sets), a window at a time
+// Each step searches exhaustively (see BitsetSearch) for the best window
+// tracks to play after the end of the mix so far, keeps the first commit of
+// them and slides on from there
+// Nothing is rebuilt between windows: the bitsets are built once, the tracks
+// still remaining are carried from one window to the next, and whatever of a
+// window wasn't kept is the incumbent the next search has to beat
+// Windows only follow each node's kHorizonDegree cheapest edges, so each one
+// costs about the same however big the library is, and time grows with the
+// length of the mix. Once every one of those is played, the mix carries on
+// through the cheapest transition left to any track
+// Holds the state of one plan at a time
+class HorizonPlanner
+{
+public:
+
+  // Keeps a thinned copy of graph (a kRuleKeyShift graph)
+  void Build(CompatibilityGraph const& graph);
+
+  // Builds the thinned graph straight from tracks, without the full graph
+  // ever being held (see CompatibilityGraph::Build)
+  void Build(Tracks const& tracks, CostModel cost = kCostDefault, size_t threads = 0);
+
+  // The thinned graph plans follow
+  CompatibilityGraph const& GetGraph() const;
+
+  // A mix of up to max_len tracks from start_node, with commit of every
+  // window tracks kept at each step
+  // Stops early (with the mix so far) once budget seconds have gone, unless
+  // budget is 0
+  Mix Plan(
+    Tracks const& tracks,
+    int start_node,
+    size_t window,
+    size_t commit,
+    size_t max_len,
+    double budget = 0,
+    ConvergenceTrace* trace = nullptr,
+    CostAggregate aggregate = kAggregateSum
+    );
+
+  // Where a plan starts by default: of the tracks (in their own keys) that
+  // could start the longest mix parts allows, the slowest, as sets mostly
+  // build up in tempo
+  static int FindStart(
+    Tracks const& tracks,
+    CompatibilityGraph const& graph,
+    GraphComponents const& parts
+    );
+
+protected:
+
+  // Cheapest edge from node to track in the thinned graph
+  GraphEdge const* FindEdge(int node, int track) const;
+
+  // Cheapest edge from node to any track not yet played
+  bool FindRemaining(Tracks const& tracks, int node, GraphEdge& edge) const;
+
+  CompatibilityGraph near;
+  BitsetSearch       search;
+
+  // Tracks not yet kept in the mix, one bit each
+  std::vector<BitsetSearch::Word> remaining;
+};
+
+#endif
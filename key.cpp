@@ -5,10 +5,6 @@
 #include "key.h"
 #include "utils.h"
 
-static Keys keys;
-static Keys ordering_min;
-static Keys ordering_maj;
-
 static std::string kKeyNames[][2] = {
   { "A-Flat Minor", "B Major" },
   { "E-Flat Minor", "F-Sharp Major" },
@@ -89,12 +85,11 @@ std::string Key::GetAlternateName(
   return kKeyAlternateNames[num-1][type];
 }
 
-Keys const& Key::GetKeys()
+// The key tables are built once, on first use, by whichever thread gets there
+// first (function-local statics are initialized thread-safely)
+static Keys MakeKeys()
 {
-  if (!keys.empty()) {
-    return keys;
-  }
-
+  Keys keys;
   keys.push_back(Key(1,  Key::kMinor));
   keys.push_back(Key(4,  Key::kMajor));
   keys.push_back(Key(8,  Key::kMinor));
@@ -123,13 +118,12 @@ Keys const& Key::GetKeys()
   return keys;
 }
 
-Keys const& Key::GetOrdering(Key::Type type)
+static Keys MakeOrdering(Key::Type type)
 {
+  Keys ordering_min;
+  Keys ordering_maj;
   switch (type) {
   case Key::kMinor:
-    if (!ordering_min.empty()) {
-      return ordering_min;
-    }
     ordering_min.push_back(Key::GetKey(5,  Key::kMinor));
     ordering_min.push_back(Key::GetKey(12, Key::kMinor));
     ordering_min.push_back(Key::GetKey(7,  Key::kMinor));
@@ -144,9 +138,6 @@ Keys const& Key::GetOrdering(Key::Type type)
     ordering_min.push_back(Key::GetKey(10, Key::kMinor));
     return ordering_min;
   case Key::kMajor:
-    if (!ordering_maj.empty()) {
-      return ordering_maj;
-    }
     ordering_maj.push_back(Key::GetKey(8,  Key::kMajor));
     ordering_maj.push_back(Key::GetKey(3,  Key::kMajor));
     ordering_maj.push_back(Key::GetKey(10, Key::kMajor));
@@ -165,6 +156,26 @@ Keys const& Key::GetOrdering(Key::Type type)
   throw "Invalid key type";
 }
 
+Keys const& Key::GetKeys()
+{
+  static Keys const keys = MakeKeys();
+  return keys;
+}
+
+Keys const& Key::GetOrdering(Key::Type type)
+{
+  static Keys const ordering_min = MakeOrdering(Key::kMinor);
+  static Keys const ordering_maj = MakeOrdering(Key::kMajor);
+  switch (type) {
+  case Key::kMinor:
+    return ordering_min;
+  case Key::kMajor:
+    return ordering_maj;
+  }
+
+  throw "Invalid key type";
+}
+
 Key Key::KeyFromString(std::string const& str)
 {
   Keys keys = GetKeys();
@@ -196,9 +207,10 @@ Key Key::operator+(int semitones) const
     semitones = 12 - (abs(semitones) % 12);
   }
 
+  Keys const& keys = GetKeys();
   int key_index = GetKeyIndex(*this);
-  int key_shifted = (key_index + 2 * semitones) % GetKeys().size();
-  return GetKeys()[key_shifted];
+  int key_shifted = (key_index + 2 * semitones) % keys.size();
+  return keys[key_shifted];
 }
 
 Key Key::operator-(int semitones) const
@@ -217,14 +229,24 @@ bool Key::operator<(Key const& k) const
   }
 }
 
+// Position in GetKeys of every (num, type), so lookups don't have to search
+static std::vector<int> MakeKeyIndices()
+{
+  Keys const& keys = Key::GetKeys();
+  std::vector<int> indices(2 * 12, 0);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    indices[2 * (keys[i].num - 1) + keys[i].type] = static_cast<int>(i);
+  }
+  return indices;
+}
+
 int Key::GetKeyIndex(Key const& key)
 {
-  for (size_t i = 0; i < GetKeys().size(); ++i) {
-    if (key == GetKeys()[i]) {
-      return i;
-    }
+  static std::vector<int> const indices = MakeKeyIndices();
+  if (key.num < 1 || key.num > 12) {
+    return 0;
   }
-  return 0;
+  return indices[2 * (key.num - 1) + key.type];
 }
 
 int round_int(double r) {
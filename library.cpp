@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "library.h"
+#include "metrics.h"
+
+static time_t GetModifiedTime(std::string const& path)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return 0;
+  }
+  return st.st_mtime;
+}
+
+Library::Library() : modified(0)
+{
+}
+
+bool Library::ReadTabSeparated(
+  std::string const& path,
+  Tracks& tracks,
+  std::vector<std::string>& names
+  )
+{
+  tracks.clear();
+  names.clear();
+
+  // Read the file to get our tracks
+  std::ifstream ifs(path);
+  if (!ifs) {
+    return false;
+  }
+  std::string line;
+  int idx = 0;
+  while (getline(ifs, line)) {
+    std::stringstream ss(line);
+
+    std::string name;
+    getline(ss, name, '\t');
+
+    std::string key_str;
+    getline(ss, key_str, '\t');
+    Key key = Key::KeyFromString(key_str);
+
+    double bpm;
+    ss >> bpm;
+
+    // Allow commenting out tracks
+    if (!name.substr(0, 2).compare("//")) {
+      continue;
+    }
+
+    tracks.push_back(Track(idx++, bpm, key));
+    names.push_back(name);
+  }
+  ifs.close();
+  return true;
+}
+
+void Library::WriteTabSeparated(
+  std::string const& path,
+  Tracks const& tracks,
+  std::vector<std::string> const& names
+  )
+{
+  std::ofstream ofs(path);
+  for (auto const& t : tracks) {
+    ofs << names[t.idx] << "\t" << Key::GetShortName(t.key.num, t.key.type) << "\t" << t.bpm << std::endl;
+  }
+  ofs.close();
+}
+
+void Library::Load(std::string const& path)
+{
+  this->path = path;
+  modified = GetModifiedTime(path);
+
+  {
+    METRIC_TIME(kTimeParse);
+    ReadTabSeparated(path, tracks, names);
+  }
+
+  key_counts.clear();
+  key_buckets.clear();
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    Index(i);
+  }
+}
+
+bool Library::Poll()
+{
+  // A file we can't stat or open is most likely mid-save (editors often
+  // write a new file and rename it over the old one), so rather than taking
+  // it as an empty library we leave everything be and look again next time
+  time_t now_modified = GetModifiedTime(path);
+  if (path.empty() || now_modified == 0 || now_modified == modified) {
+    return false;
+  }
+
+  Tracks now_tracks;
+  std::vector<std::string> now_names;
+  if (!ReadTabSeparated(path, now_tracks, now_names)) {
+    return false;
+  }
+  modified = now_modified;
+
+  // Match tracks up by name -- anything left over on our side has been removed
+  std::multimap<std::string, int> unmatched;
+  for (size_t i = 0; i < names.size(); ++i) {
+    unmatched.insert(std::make_pair(names[i], static_cast<int>(i)));
+  }
+
+  bool changed = false;
+  std::vector<int> added;
+  for (size_t i = 0; i < now_tracks.size(); ++i) {
+    auto it = unmatched.find(now_names[i]);
+    if (it == unmatched.end()) {
+      added.push_back(i);
+      continue;
+    }
+
+    Track const& t = tracks[it->second];
+    if (t.bpm != now_tracks[i].bpm || !(t.key == now_tracks[i].key)) {
+      Update(it->second, now_tracks[i].bpm, now_tracks[i].key);
+      changed = true;
+    }
+    unmatched.erase(it);
+  }
+
+  // Highest first, since removal moves the last track into the gap
+  std::vector<int> removed;
+  for (auto const& u : unmatched) {
+    removed.push_back(u.second);
+  }
+  std::sort(removed.rbegin(), removed.rend());
+  for (auto idx : removed) {
+    Remove(idx);
+  }
+
+  for (auto i : added) {
+    Add(now_names[i], now_tracks[i].bpm, now_tracks[i].key);
+  }
+
+  return changed || !removed.empty() || !added.empty();
+}
+
+int Library::Add(std::string const& name, double bpm, Key const& key)
+{
+  int idx = tracks.size();
+  tracks.push_back(Track(idx, bpm, key));
+  names.push_back(name);
+
+  Index(idx);
+  return idx;
+}
+
+void Library::Remove(int idx)
+{
+  int last = tracks.size() - 1;
+  Unindex(idx);
+
+  // Move the last track into the gap so only its indices shift
+  if (idx != last) {
+    Unindex(last);
+
+    tracks[idx] = tracks[last];
+    tracks[idx].idx = idx;
+    names[idx] = names[last];
+
+    Index(idx);
+  }
+
+  tracks.pop_back();
+  names.pop_back();
+}
+
+void Library::Update(int idx, double bpm, Key const& key)
+{
+  Unindex(idx);
+  tracks[idx].bpm = bpm;
+  tracks[idx].log_bpm = Track::LogBPM(bpm);
+  tracks[idx].key = key;
+  Index(idx);
+}
+
+Tracks const& Library::GetTracks() const
+{
+  return tracks;
+}
+
+std::vector<std::string> const& Library::GetNames() const
+{
+  return names;
+}
+
+KeyCount const& Library::GetKeyCounts() const
+{
+  return key_counts;
+}
+
+KeyBuckets const& Library::GetKeyBuckets() const
+{
+  return key_buckets;
+}
+
+void Library::Index(int idx)
+{
+  Key const& key = tracks[idx].key;
+  key_counts[key]++;
+  key_buckets[key].push_back(idx);
+}
+
+void Library::Unindex(int idx)
+{
+  Key const& key = tracks[idx].key;
+  if (--key_counts[key] == 0) {
+    key_counts.erase(key);
+  }
+
+  std::vector<int>& bucket = key_buckets[key];
+  bucket.erase(std::find(bucket.begin(), bucket.end(), idx));
+  if (bucket.empty()) {
+    key_buckets.erase(key);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mixant.h"
+#include "track.h"
+
+typedef std::map<Key, int> KeyCount;
+typedef std::map<Key, std::vector<int> > KeyBuckets;
+
+// A track library that keeps everything the solvers need in sync
+// Adding, removing or re-tagging a track only touches the affected key
+// bucket and key count instead of rebuilding the lot
+// Transition costs aren't kept here: the solvers build a CompatibilityGraph
+// from the tracks, which only holds the edges that can actually be taken
+// Track indices always match positions, so Track::idx stays usable for names
+class Library
+{
+public:
+
+  Library();
+
+  // Replaces the library with the contents of a tab separated file, which is
+  // then watched by Poll
+  void Load(std::string const& path);
+
+  // Applies any changes made to the loaded file since we last looked
+  // Returns true if the library changed
+  bool Poll();
+
+  int  Add(std::string const& name, double bpm, Key const& key);
+  void Remove(int idx);
+  void Update(int idx, double bpm, Key const& key);
+
+  Tracks const&                   GetTracks() const;
+  std::vector<std::string> const& GetNames() const;
+  KeyCount const&                 GetKeyCounts() const;
+  KeyBuckets const&               GetKeyBuckets() const;
+
+  // Returns false if the file couldn't be opened
+  static bool ReadTabSeparated(
+    std::string const& path,
+    Tracks& tracks,
+    std::vector<std::string>& names
+    );
+
+  static void WriteTabSeparated(
+    std::string const& path,
+    Tracks const& tracks,
+    std::vector<std::string> const& names
+    );
+
+protected:
+
+  void Index(int idx);
+  void Unindex(int idx);
+
+  std::string              path;
+  time_t                   modified;
+  Tracks                   tracks;
+  std::vector<std::string> names;
+  KeyCount                 key_counts;
+  KeyBuckets               key_buckets;
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+static const size_t kRingSlots = 1024;
+static const size_t kSlotSize  = 256;
+
+// How long the drain thread sleeps when there's nothing to write
+static const int kDrainIntervalMs = 20;
+
+// Rings kept for reuse once their threads have exited (the rest are freed
+// once they've been drained)
+static const size_t kSpareRings = 8;
+
+static char const* kLevelPrefixes[] = {
+  "",
+  "",
+  "Warning: ",
+  "Error: "
+};
+
+// Single producer (the owning thread), single consumer (whoever holds the
+// drain mutex) ring of fixed size messages
+struct LogRing
+{
+  struct Slot
+  {
+    LogLevel level;
+    size_t   len;
+    char     text[kSlotSize];
+  };
+
+  LogRing() : head(0), tail(0), dropped(0), released(false) {}
+
+  bool Push(LogLevel level, std::string const& message)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= kRingSlots) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    Slot& slot = slots[h % kRingSlots];
+    slot.level = level;
+    slot.len = std::min(message.size(), kSlotSize);
+    memcpy(slot.text, message.data(), slot.len);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Writes out everything queued, and returns how many messages that was
+  size_t Drain(std::ostream& out)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    for (size_t i = t; i != h; ++i) {
+      Slot const& slot = slots[i % kRingSlots];
+      out << kLevelPrefixes[slot.level];
+      out.write(slot.text, slot.len);
+      out << '\n';
+    }
+    tail.store(h, std::memory_order_release);
+
+    size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+      out << kLevelPrefixes[kLogWarning] << "dropped " << lost << " log messages" << '\n';
+    }
+    return h - t;
+  }
+
+  Slot                slots[kRingSlots];
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<size_t> dropped;
+
+  // Set by the owning thread as it exits, after its last message
+  std::atomic<bool>   released;
+};
+
+// Owns every thread's ring (so messages survive their thread) and the thread
+// that writes them out
+// A thread hands its ring back when it exits, for the next thread that logs
+// to take over, so short lived threads don't pile up rings
+class LogDrain
+{
+public:
+
+  LogDrain() : stop(false), drainer(&LogDrain::Run, this) {}
+
+  ~LogDrain()
+  {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex);
+      stop = true;
+    }
+    wake.notify_one();
+    drainer.join();
+    DrainAll();
+  }
+
+  // Reuses a ring some exited thread handed back, if there is one: its
+  // thread is done with it, so anything still queued just goes out first
+  LogRing* Register()
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    for (auto const& r : rings) {
+      if (r->released.load(std::memory_order_acquire)) {
+        r->released = false;
+        return r.get();
+      }
+    }
+    rings.push_back(std::unique_ptr<LogRing>(new LogRing()));
+    return rings.back().get();
+  }
+
+  void Release(LogRing* ring)
+  {
+    ring->released.store(true, std::memory_order_release);
+  }
+
+  size_t DrainAll()
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    size_t written = 0;
+    size_t spare = 0;
+    for (size_t i = 0; i < rings.size();) {
+      written += rings[i]->Drain(std::cout);
+
+      // Free handed back rings we don't need to keep around (registering
+      // takes the same lock, so nobody can be writing to them)
+      if (!rings[i]->released.load(std::memory_order_acquire) || spare++ < kSpareRings) {
+        ++i;
+        continue;
+      }
+      rings[i].swap(rings.back());
+      rings.pop_back();
+    }
+    if (written) {
+      std::cout.flush();
+    }
+    return written;
+  }
+
+protected:
+
+  void Run()
+  {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (!stop) {
+      lock.unlock();
+      DrainAll();
+      lock.lock();
+      wake.wait_for(lock, std::chrono::milliseconds(kDrainIntervalMs));
+    }
+  }
+
+  std::mutex                            drain_mutex;
+  std::vector<std::unique_ptr<LogRing> > rings;
+
+  std::mutex              wake_mutex;
+  std::condition_variable wake;
+  bool                    stop;
+  std::thread             drainer;
+};
+
+static std::atomic<int> log_level(kLogInfo);
+
+static LogDrain& GetDrain()
+{
+  static LogDrain drain;
+  return drain;
+}
+
+// Hands the thread's ring back when the thread exits
+struct RingHandle
+{
+  RingHandle() : ring(GetDrain().Register()) {}
+
+  ~RingHandle()
+  {
+    GetDrain().Release(ring);
+  }
+
+  LogRing* ring;
+};
+
+static LogRing& GetRing()
+{
+  static thread_local RingHandle handle;
+  return *handle.ring;
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+  log_level = level;
+}
+
+LogLevel Logger::GetLevel()
+{
+  return static_cast<LogLevel>(log_level.load());
+}
+
+bool Logger::Enabled(LogLevel level)
+{
+  return level >= log_level.load(std::memory_order_relaxed);
+}
+
+void Logger::Write(LogLevel level, std::string const& message)
+{
+  GetRing().Push(level, message);
+}
+
+bool Logger::Due(double& last, double interval)
+{
+  using namespace std::chrono;
+  double now = duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+  if (now - last < interval) {
+    return false;
+  }
+  last = now;
+  return true;
+}
+
+void Logger::Flush()
+{
+  GetDrain().DrainAll();
+}
+
+// Each thread reuses one stream to format into
+static std::ostringstream& GetStream()
+{
+  static thread_local std::ostringstream ss;
+  return ss;
+}
+
+LogMessage::LogMessage(LogLevel level) : level(level)
+{
+  GetStream().str("");
+  GetStream().clear();
+}
+
+LogMessage::~LogMessage()
+{
+  Logger::Write(level, GetStream().str());
+}
+
+std::ostream& LogMessage::stream()
+{
+  return GetStream();
+}
@@ -0,0 +1,62 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <sstream>
+#include <string>
+
+// Progress messages from solver loops go out at most this often (seconds)
+static const double kProgressInterval = 1.0;
+
+enum LogLevel
+{
+  kLogDebug,
+  kLogInfo,
+  kLogWarning,
+  kLogError
+};
+
+// A leveled logger that keeps terminal I/O off the solver threads
+// Messages are copied into a lock-free ring buffer owned by the logging thread
+// and written out by a background thread, so logging never waits on stdout
+// If a ring fills up (the terminal really can't keep up), new messages are
+// dropped and counted rather than blocking the caller
+class Logger
+{
+public:
+
+  static void     SetLevel(LogLevel level);
+  static LogLevel GetLevel();
+  static bool     Enabled(LogLevel level);
+
+  static void Write(LogLevel level, std::string const& message);
+
+  // For rate limiting progress messages
+  // Returns true (and updates last) if at least interval seconds have passed
+  static bool Due(double& last, double interval);
+
+  // Blocks until everything logged so far has been written
+  // Call this before writing to stdout directly so output stays in order
+  static void Flush();
+};
+
+// Formats a single message and hands it to the logger when it goes away
+class LogMessage
+{
+public:
+
+  LogMessage(LogLevel level);
+  ~LogMessage();
+
+  std::ostream& stream();
+
+protected:
+
+  LogLevel level;
+};
+
+// LOG(kLogInfo) << "Found " << n << " tracks";
+// Nothing after the << gets evaluated if the level is turned off
+#define LOG(level) \
+  if (!Logger::Enabled(level)) ; else LogMessage(level).stream()
+
+#endif
@@ -1,176 +1,367 @@
 #include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
-#include <map>
-#include <set>
-#include <sstream>
+#include <string>
 
+#include "cache.h"
+#include "diverse.h"
+#include "engine.h"
 #include "key.h"
-#include "mixant.h"
-#include "track.h"
-#include "utils.h"
+#include "logger.h"
+#include "metrics.h"
+#include "pareto.h"
+#include "server.h"
+#include "tempo.h"
+#include "transition.h"
 
 using namespace std;
 
-static const double kBPMThresh = 0.3;
-static const int kKeyShiftThresh = 1;
-static const int kMixSongLen = 20;
-
-struct TrackOption
-{
-  Track track;
-  double bpm_ratio;
-  int idx;
-
-  TrackOption(Track const& track, double bpm_ratio, int idx) : track(track), bpm_ratio(bpm_ratio), idx(idx) {}
-};
-
-//typedef map< Key, vector<Track> > KeyCount
-typedef set<Key> KeySet;
-typedef map<Key, int> KeyCount;
-
-KeySet GetAvailableKeys(KeyCount const& kc)
+// A thin command line front end to the engine
+//
+// Usage: mixant [--library tracks_tsv.txt]
+//               [--solver exhaustive|ant|bottleneck|horizon]
+//               [--runs N] [--seed S] [--trace trace.csv] [--front front.txt]
+//               [--cost transition|shift] [--aggregate sum|max]
+//               [--alternatives K] [--diversity D] [--window W] [--commit C]
+//        mixant --partition P [--threads N] [--cost transition|shift]
+//               [--trace trace.csv]
+//        mixant --serve socket_path [--threads N]
+//
+// The exhaustive, bottleneck and horizon solvers print the best mix they find
+// (the horizon planner looking W tracks ahead and keeping C at a time)
+// With --front, every mix no other beats on length, total cost and worst
+// transition is written out too, and with --alternatives the K best mixes
+// that share less than 1 - D of their transitions go to alternatives.txt
+// The ant solver also reuses (or warm-starts from) mix_cache.txt, plans the
+// tempo ramps, and writes mix.txt and unused.txt
+// With --partition, the library is split into P mixes sharing no tracks,
+// which are all printed (and what's left goes to unused.txt)
+// With --serve, we stay resident and answer requests (see server.h) instead
+
+// A warm-started solve only has to improve on the cached mix
+static const int kWarmMixRuns = kMixRuns / 10;
+
+// Checks every entry of the transition table against the key searches it
+// replaced
+static void TestTransitions()
 {
-  KeySet available;
-  for (auto k : kc) {
-    if (k.second <= 0) {
-      continue;
+  Keys const& keys = Key::GetKeys();
+  for (auto const& a : keys) {
+    Keys compatible;
+    Key::GetCompatibleKeys(a, compatible);
+
+    for (auto const& b : keys) {
+      Transition const& t = TransitionTable::Get(a, b);
+      assert(t.key_distance == Key::GetCamelotDistance(a, b));
+
+      // Smallest transposition of b onto a key compatible with a
+      int transpose = INT_MAX;
+      for (auto const& k : compatible) {
+        if (k.type == b.type && abs(Key::GetTransposeDistance(b, k)) < abs(transpose)) {
+          transpose = Key::GetTransposeDistance(b, k);
+        }
+      }
+      assert(t.transpose == transpose);
+      assert(MixAnt::FindTranspose(a, b) == transpose);
+
+      // b as it is if that's compatible, otherwise the nearest compatible key
+      // of its type (the last of any ties)
+      Key play = b;
+      if (!Key::AreCompatibleKeys(b, a)) {
+        int nearest = INT_MAX;
+        for (auto const& k : compatible) {
+          if (k.type == b.type && abs(Key::GetTransposeDistance(b, k)) <= nearest) {
+            nearest = abs(Key::GetTransposeDistance(b, k));
+            play = k;
+          }
+        }
+      }
+      assert(keys[t.play_key] == play);
+      assert(MixAnt::ChoosePlayKey(a, b) == play);
+      assert(t.tuning == Key::GetTransposeDistance(b, play));
+
+      // Smallest shift that makes b compatible, downwards on ties
+      int shift = 0;
+      while (!Key::AreCompatibleKeys(a, b - shift) && !Key::AreCompatibleKeys(a, b + shift)) {
+        ++shift;
+        assert(shift <= 6);
+      }
+      if (Key::AreCompatibleKeys(a, b - shift)) {
+        shift = -shift;
+      }
+      assert(t.shift == shift);
+      assert(keys[t.shift_key] == b + shift);
     }
-    available.insert(k.first);
   }
-  return available;
 }
 
-bool ChooseKey(Key const& key, KeyCount const& key_count, Keys order, int depth, int& max_depth)
+static void TestTempo()
 {
-  if (depth > max_depth) {
-    max_depth = depth;
-    cout << "New max depth: " << max_depth << endl;
+  TempoPlanner planner;
+  Key Am = Key::KeyFromString("Am");
+
+  // A track played a semitone up is sped up by a semitone, if it's allowed
+  Mix m;
+  m.steps.push_back(MixStep(Track(0, 120, Am)));
+  m.steps.back().SetPlayKey(Am + 1);
+  assert(planner.Plan(m) < 1e-9);
+  assert(fabs(m.steps[0].bpm_beg - 120 * pow(2, 1 / 12.0)) < 1e-6);
+  assert(fabs(m.steps[0].bpm_end - m.steps[0].bpm_beg) < 1e-6);
+
+  // Two semitones is more than kMaxStretch allows, so it stops at the limit
+  m.steps[0].SetPlayKey(Am + 2);
+  assert(planner.Plan(m) > 0);
+  assert(fabs(m.steps[0].bpm_beg - 120 * (1 + kMaxStretch)) < 1e-6);
+
+  // A mix where the best plan lets go of a limit it first ran into: no
+  // hand-off can move (within its limits) and leave less to tune
+  int const bpms[] = { 124, 118, 126, 121, 119, 120 };
+  int const tunings[] = { 2, -1, 0, 2, -2, 1 };
+  double const stretches[] = { 0.05, 0.01, 0.08, 0.03, 0.08, 0.02 };
+  size_t const steps = 6;
+  std::vector<double> stretch(stretches, stretches + steps);
+  m.steps.clear();
+  for (size_t i = 0; i < steps; ++i) {
+    m.steps.push_back(MixStep(Track(static_cast<int>(i), bpms[i], Am)));
+    m.steps.back().SetPlayKey(Am + tunings[i]);
   }
+  planner.Plan(m, &stretch);
 
-  // We've run out of tracks!
-  // We've found a potential solution!
-  if (GetAvailableKeys(key_count).empty()) {
+  auto semitones = [](double bpm) { return 12 * log(bpm) / log(2.0); };
+  std::vector<double> x(steps + 1);
+  for (size_t i = 0; i < steps; ++i) {
+    x[i] = semitones(m.steps[i].bpm_beg);
+    x[i+1] = semitones(m.steps[i].bpm_end);
+  }
+  auto objective = [&](std::vector<double> const& x)
+  {
+    double total = 0;
+    for (size_t i = 0; i < steps; ++i) {
+      double target = semitones(bpms[i]) + tunings[i];
+      total += pow(x[i] - target, 2) + pow(x[i+1] - target, 2) + kRampWeight * pow(x[i] - x[i+1], 2);
+    }
+    return total;
+  };
+  auto allowed = [&](std::vector<double> const& x, size_t j)
+  {
+    for (size_t i = (j > 0 ? j - 1 : 0); i <= j && i < steps; ++i) {
+      if (fabs(x[j] - semitones(bpms[i])) > semitones(1 + stretch[i]) + 1e-12) {
+        return false;
+      }
+    }
     return true;
+  };
+  for (size_t j = 0; j <= steps; ++j) {
+    for (double nudge : { -1e-3, 1e-3 }) {
+      std::vector<double> y(x);
+      y[j] += nudge;
+      assert(!allowed(y, j) || objective(y) >= objective(x) - 1e-12);
+    }
   }
+}
 
-  // Add it to our order, but it's no longer available
-  order.push_back(key);
+static void TestPareto()
+{
+  ParetoArchive front;
+  CompactMix mix;
+  assert(front.Offer(3, 10, 5, mix));
+  assert(!front.Offer(3, 12, 6, mix));
+  assert(!front.Offer(3, 10, 5, mix));
+
+  // Shorter, but cheaper
+  assert(front.Offer(2, 5, 5, mix));
+
+  // Beats the first on worst transition alone, and replaces it
+  assert(front.Offer(3, 10, 4, mix));
+  assert(front.size() == 2);
+  ParetoEntries entries = front.GetFront();
+  assert(entries[0].length == 3 && entries[0].worst == 4);
+  assert(entries[1].length == 2);
+
+  ParetoArchive other;
+  other.Offer(4, 20, 8, mix);
+  other.Offer(2, 6, 6, mix);
+  front.Merge(other);
+  assert(front.size() == 3);
+  assert(front.GetFront()[0].length == 4);
+}
 
-  // Make our own copy to iterate through...
-  // Subtract an instance of the key we just used
-  KeyCount new_counts(key_count);
-  if (--new_counts[key] == 0) {
-    new_counts.erase(key);
-  }
-  
-  // Find all compatible tracks, then try to choose each one in turn
-  bool found_compatible = false;
-  Keys compatible;
-  Key::GetCompatibleKeys(key, compatible);
-  for (auto k : compatible) {
-    if (new_counts.find(k) != new_counts.end()) {
-      ChooseKey(k, new_counts, order, depth + 1, max_depth);
-      found_compatible = true;
+static void TestDiversity()
+{
+  auto make = [](std::vector<int> const& order)
+  {
+    CompactMix mix;
+    for (auto t : order) {
+      mix.Push(t, Key::KeyFromString("Am"), 120, 120);
     }
-  }
+    return mix;
+  };
+
+  CompactMix a = make({ 1, 2, 3, 4 });
+  assert(DiverseMixes::Distance(a, a) == 0);
+
+  // The same tracks the other way round share no transitions
+  assert(DiverseMixes::Distance(a, make({ 4, 3, 2, 1 })) == 1);
+
+  // Two of three transitions in common
+  assert(fabs(DiverseMixes::Distance(a, make({ 1, 2, 3, 5 })) - 1 / 3.0) < 1e-12);
 
-  // Dead end solution...
-  return found_compatible;
+  // Out of the longer mix's transitions
+  assert(fabs(DiverseMixes::Distance(a, make({ 1, 2 })) - 2 / 3.0) < 1e-12);
+
+  // Single tracks have nothing to share but the track
+  assert(DiverseMixes::Distance(make({ 1 }), make({ 1 })) == 0);
+  assert(DiverseMixes::Distance(make({ 1 }), make({ 2 })) == 1);
 }
 
-//bool ChooseTrack(Track const& track, Tracks const& available, Tracks order)
-//{
-//  // We've run out of tracks!
-//  // We've found a potential solution!
-//  if (available.empty()) {
-//    return true;
-//  }
-//
-//  // Add it to our order, but it's no longer available
-//  order.push_back(track);
-//
-//  // Make our own copy to iterate through...
-//  Tracks now_available(available);
-//  
-//  // Erase the one we just took
-//  now_available.erase(find(now_available.begin(), now_available.end(), track));
-//
-//  // Find all compatible tracks, then try to choose each one in turn
-//  bool found_compatible = false;
-//  for (auto t : now_available) {
-//    if (Key::AreCompatibleKeys(track.key, t.key)) {
-//      ChooseTrack(t, now_available, order);
-//      found_compatible = true;
-//    }
-//  }
-//
-//  // Dead end solution...
-//  return found_compatible;
-//}
+// Writes the tracks out as a library and loads it like any other
+static void LoadTestLibrary(Engine& engine, Tracks const& tracks)
+{
+  vector<string> names;
+  for (auto const& t : tracks) {
+    names.push_back("track " + to_string(t.idx));
+  }
+  string path = "mixant_test_tsv.txt";
+  Library::WriteTabSeparated(path, tracks, names);
+  engine.Load(path);
+  remove(path.c_str());
+  assert(engine.GetLibrary().GetTracks().size() == tracks.size());
+}
 
-void GetTracks(string const& path, Tracks& tracks, vector<string>& names)
+// Suggestions from the neighbor index against a scan of every track
+static void TestSuggest()
 {
-  tracks.clear();
-
-  // Read the file to get our tracks
-  ifstream ifs(path);
-  string line;
-  int idx = 0;
-  while (getline(ifs, line)) {
-    string name = line;
-
-    getline(ifs, line);
-    Key key = Key::KeyFromString(line);
-
-    double bpm;
-    getline(ifs, line);
-    stringstream ss(line);
-    ss >> bpm;
-
-    // Allow commenting out tracks
-    if (!name.substr(0, 2).compare("//")) {
-      continue;
+  static const size_t kCount = 10;
+
+  Tracks tracks;
+  Keys const& keys = Key::GetKeys();
+  for (int i = 0; i < 96; ++i) {
+    tracks.push_back(Track(i, 100 + (i * 37) % 90, keys[(i * 7) % keys.size()]));
+  }
+  Engine engine;
+  LoadTestLibrary(engine, tracks);
+  Tracks const& loaded = engine.GetLibrary().GetTracks();
+
+  vector<bool> played(loaded.size());
+  for (size_t i = 0; i < played.size(); i += 5) {
+    played[i] = true;
+  }
+
+  for (int from = 0; from < static_cast<int>(loaded.size()); ++from) {
+    Key play_key = keys[(from * 5) % keys.size()];
+    Suggestions suggestions = engine.Suggest(from, play_key, played, kCount);
+
+    vector<double> costs;
+    for (int t = 0; t < static_cast<int>(loaded.size()); ++t) {
+      double cost = MixAnt::FindDistance(loaded[from].bpm, loaded[t].bpm, play_key, loaded[t].key);
+      if (t != from && !played[t] && cost < kDistThreshold) {
+        costs.push_back(cost);
+      }
+    }
+    sort(costs.begin(), costs.end());
+    costs.resize(min(costs.size(), kCount));
+
+    assert(suggestions.size() == costs.size());
+    for (size_t i = 0; i < suggestions.size(); ++i) {
+      Suggestion const& s = suggestions[i];
+      assert(s.cost < kDistThreshold);
+      assert(fabs(s.cost - costs[i]) < 1e-9);
+      assert(fabs(s.cost - MixAnt::FindDistance(loaded[from].bpm, loaded[s.track].bpm, play_key, loaded[s.track].key)) < 1e-9);
+      assert(s.track != from && !played[s.track]);
+      assert(s.play_key == MixAnt::ChoosePlayKey(play_key, loaded[s.track].key));
     }
+  }
 
-    tracks.push_back(Track(idx++, bpm, key));
-    names.push_back(name);
+  // An index updated after edits (as Library::Poll makes them) answers just
+  // like one built from scratch
+  NeighborIndex updated;
+  updated.Build(tracks);
+  Tracks edited(tracks);
+  edited[3] = Track(3, 140, keys[1]);
+  edited[10] = Track(10, edited.back().bpm, edited.back().key);
+  edited.pop_back();
+  edited.push_back(Track(static_cast<int>(edited.size()), 128, keys[4]));
+  updated.Update(edited);
+  NeighborIndex built;
+  built.Build(edited);
+
+  vector<bool> none(edited.size());
+  for (int from = 0; from < static_cast<int>(edited.size()); ++from) {
+    Suggestions a;
+    Suggestions b;
+    updated.Query(from, edited[from].key, none, kCount, a, kDistThreshold);
+    built.Query(from, edited[from].key, none, kCount, b, kDistThreshold);
+    assert(a.size() == b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+      assert(a[i].cost == b[i].cost);
+    }
   }
-  ifs.close();
 }
 
-void GetTracksTabSeparated(string const& path, Tracks& tracks, vector<string>& names)
+// The exhaustive search's alternatives against every mix there is
+// Nothing is too alike at a diversity of 0, so they have to be the K best
+static void TestAlternatives()
 {
-  tracks.clear();
-
-  // Read the file to get our tracks
-  ifstream ifs(path);
-  string line;
-  int idx = 0;
-  while (getline(ifs, line)) {
-    stringstream ss(line);
-    
-    string name;
-    getline(ss, name, '\t');
-
-    string key_str;
-    getline(ss, key_str, '\t');
-    Key key = Key::KeyFromString(key_str);
-
-    double bpm;
-    ss >> bpm;
-
-    // Allow commenting out tracks
-    if (!name.substr(0, 2).compare("//")) {
-      continue;
-    }
+  static const size_t kCount = 20;
 
-    tracks.push_back(Track(idx++, bpm, key));
-    names.push_back(name);
+  char const* const names[] = { "Am", "Em", "C", "G", "Dm", "F", "Bm", "Am", "D", "Em" };
+  int const bpms[] = { 120, 124, 122, 126, 118, 121, 125, 128, 123, 119 };
+  Tracks tracks;
+  for (int i = 0; i < 10; ++i) {
+    tracks.push_back(Track(i, bpms[i], Key::KeyFromString(names[i])));
+  }
+  Engine engine;
+  LoadTestLibrary(engine, tracks);
+  Tracks const& loaded = engine.GetLibrary().GetTracks();
+
+  // Every path through the graph the search walks, from each track in its
+  // own key
+  CompatibilityGraph graph;
+  graph.Build(loaded, kRuleKeyShift);
+  vector<pair<size_t, double> > mixes;
+  vector<bool> used(loaded.size());
+  function<void(int, size_t, double)> walk = [&](int node, size_t len, double cost)
+  {
+    mixes.push_back(make_pair(len, cost));
+    for (auto e = graph.EdgesBegin(node); e != graph.EdgesEnd(node); ++e) {
+      int t = graph.GetTrack(e->node);
+      if (!used[t]) {
+        used[t] = true;
+        walk(e->node, len + 1, cost + e->cost);
+        used[t] = false;
+      }
+    }
+  };
+  for (int t = 0; t < static_cast<int>(loaded.size()); ++t) {
+    used[t] = true;
+    walk(graph.GetStartNode(t), 1, 0);
+    used[t] = false;
+  }
+  sort(mixes.begin(), mixes.end(), [](pair<size_t, double> const& a, pair<size_t, double> const& b)
+  {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  });
+
+  DiverseMixes alternatives(kCount, 0);
+  SolveOptions options;
+  options.solver = kSolverExhaustive;
+  options.alternatives = &alternatives;
+  Mix best = engine.Solve(options);
+
+  vector<CompactMix> found = alternatives.GetMixes();
+  assert(found.size() == kCount);
+  assert(best.steps.size() == mixes[0].first);
+  for (size_t i = 0; i < kCount; ++i) {
+    assert(found[i].size() == mixes[i].first);
+    assert(fabs(found[i].cost - mixes[i].second) < 1e-9);
   }
-  ifs.close();
 }
 
 void RunTests()
@@ -201,154 +392,94 @@ void RunTests()
       assert(Key::GetTransposeDistance(keys[i], keys[j]) >= -6 && Key::GetTransposeDistance(keys[i], keys[j]) <= 6);
     }
   }
+
+  TestTransitions();
+  TestTempo();
+  TestPareto();
+  TestDiversity();
+  TestSuggest();
+  TestAlternatives();
 }
 
-// ASSUME:
-// t1 cannot be changed (bpm, key)
-// t2 can be changed (only deal with key right now)
-// We'll transpose within the key threshold
-// We assume tempo we can change kind of however we want within BPM thresholds
-// Keys we need to follow so that we don't shift down a bunch and then try to match
-// with something high in the next track
-bool AreCompatibleTracks(
-  Track const& t1, 
-  Track const& t2,
-  double bpm_thr,
-  int key_thr,
-  Key& t2_adj,
-  double& cost
-  )
+static void PrintMix(Mix const& m, vector<string> const& names)
 {
-  auto min_bpm = min(t1.bpm, t2.bpm);
-  auto max_bpm = max(t1.bpm, t2.bpm);
-  auto bpm_rat = abs(max_bpm / min_bpm);
-  bool compatible_bpm = bpm_rat < (1 + bpm_thr);
-
-  if (!compatible_bpm) {
-    return false;
-  }
-
-  // Find smallest compatible transpose distance from t2's natural key to t1
-  int min_shift_dist = INT_MAX;
-  bool compatible_keys = false;
-
-  // Try shifting t2's key to all keys within the threshold
-  for (int shift = -key_thr; shift <= key_thr; ++shift) {
-    Key shifted = t2.key + shift;
-
-    // If they're compatible, mark it!
-    if (Key::AreCompatibleKeys(t1.key, shifted)) {
-      compatible_keys = true;
-
-      // Better than previous
-      if (abs(shift) < min_shift_dist) {
-        min_shift_dist = abs(shift);
-        t2_adj = shifted;
-      }
-    }
+  METRIC_TIME(kTimeOutput);
+  for (auto const& s : m.steps) {
+    Key k = s.GetPlayKey();
+    cout
+      << setw(3) << Key::GetShortName(k.num, k.type) << " @ "
+      << setw(3) << static_cast<int>(s.bpm_beg) << "bpm"
+      << ", " << names[s.track.idx] << endl;
   }
-
-  // Cost function
-  // It's cheaper to adjust tempo (less noticeable) than to adjust key
-  cost = (bpm_rat-1) + min_shift_dist;
-
-  return compatible_keys;
+  cout << "Cost is " << m.GetTotalCost() << ", worst transition " << m.GetMaxCost() << endl;
 }
 
-void ChooseTrack(
-  vector<string> names,
-  Tracks& available, 
-  Tracks& chosen, 
-  int prev_idx,
-  Key prev_key, 
-  double prev_bpm,
-  double cost,
-  double& best_cost,
-  int max_len,
-  Tracks& best,
-  int& its
-  )
+// Reuse or warm-start from a previous result for this library if we have one
+static Mix SolveCached(Engine const& engine, SolveOptions options)
 {
-  // We're too long!
-  if (chosen.size() >= static_cast<size_t>(max_len)) {
-    return;
+  Library const& library = engine.GetLibrary();
+  MixCache cache("mix_cache.txt", MixCache::HashParams(options.cost, options.aggregate, options.runs, options.seed));
+  Mix m;
+  switch (cache.Lookup(library.GetTracks(), library.GetNames(), m)) {
+  case MixCache::kExact:
+    LOG(kLogInfo) << "Using cached mix";
+    return m;
+  case MixCache::kNear:
+    LOG(kLogInfo) << "Warm-starting from cached mix of length " << m.steps.size();
+    options.warm_start = &m;
+    options.runs = kWarmMixRuns;
+    break;
+  case MixCache::kMiss:
+    break;
   }
 
-  // We have a new best length (more important than cost)
-  if (chosen.size() > best.size()) {
-    best_cost = cost;
-    best = chosen;
-    cout << "New best of length " << best.size() << " found." << endl;
-    its = 0;
-  } 
-  // Mix length is the same, but less cost
-  else if (chosen.size() == best.size() && cost < best_cost && !chosen.empty()) {
-    best_cost = cost;
-    cout << "New best cost of " << best_cost << " found." << endl;
-    best = chosen;
-    its = 0;
-  }
-  // No improvement!
-  else {
-    ++its;
-  }
+  Mix solved = engine.Solve(options);
+  cache.Store(library.GetTracks(), library.GetNames(), solved);
+  return solved;
+}
 
-  // We've spent too long, so bail!
-  if (its >= 1000000) {
-    cout << "Too many iterations without improvement!" << endl;
-    return;
+static void WriteUnused(string const& path, Tracks const& tracks, Mix const& m)
+{
+  Tracks unused(tracks);
+  for (auto s : m.steps) {
+    for (auto it = unused.begin(); it != unused.end(); ++it) {
+      if (*it == s.track) {
+        unused.erase(it);
+        break;
+      }
+    }
   }
 
-  // Nothing to look at
-  if (available.empty()) {
-    cout << "No more tracks to choose." << endl;
-    return;
+  ofstream unused_f(path);
+  for (auto u : unused) {
+    unused_f << u.bpm << endl;
   }
+}
 
-  Track prev(prev_idx, prev_bpm, prev_key);
-
-  // Go through all available and find those compatible
-  Tracks candidates;
-  Keys candidates_adj;
-  vector<double> candidate_costs;
-
-  for (auto t : available) {
-    Key candidate_adj;
-    double this_cost;
-    if (AreCompatibleTracks(
-      prev, 
-      t, 
-      kBPMThresh, 
-      kKeyShiftThresh,
-      candidate_adj,
-      this_cost
-      )) {
-      candidates.push_back(t);
-      candidates_adj.push_back(candidate_adj);
-      candidate_costs.push_back(this_cost);
+// One mix per line, longest first: length, total cost, worst transition, and
+// then the tracks
+static void WriteFront(string const& path, ParetoArchive const& front, vector<string> const& names)
+{
+  ofstream ofs(path);
+  for (auto const& e : front.GetFront()) {
+    ofs << e.length << "\t" << e.total << "\t" << e.worst;
+    for (auto idx : e.mix.order) {
+      ofs << "\t" << names[idx];
     }
+    ofs << endl;
   }
+}
 
-  for (size_t i = 0; i < candidates.size(); ++i) {
-    Tracks now_available = available;
-    Track t = candidates[i];
-      
-    // Erase the candidate from the now available list
-    for (size_t j = 0; j < now_available.size(); ++j) {
-      if (now_available[j] == t) {
-        now_available.erase(now_available.begin() + j);
-        break;
-      }
+// One mix per line, best first: length, cost, and then the tracks
+static void WriteAlternatives(string const& path, DiverseMixes const& alternatives, vector<string> const& names)
+{
+  ofstream ofs(path);
+  for (auto const& mix : alternatives.GetMixes()) {
+    ofs << mix.size() << "\t" << mix.cost;
+    for (auto idx : mix.order) {
+      ofs << "\t" << names[idx];
     }
-
-    // Set to our new key
-    t.key = candidates_adj[i];
-
-    Tracks now_chosen = chosen;
-    now_chosen.push_back(t);
-
-    // NOTE: We send in an ADJUSTED key for this track!
-    ChooseTrack(names, now_available, now_chosen, t.idx, t.key, t.bpm, cost + candidate_costs[i], best_cost, max_len, best, its);
+    ofs << endl;
   }
 }
 
@@ -356,206 +487,140 @@ int main(int argc, char* argv[])
 {
   RunTests();
 
-  // Our tracks
-  Tracks tracks;
-  vector<string> names;
-  //GetTracks("tracks.txt", tracks);
-  GetTracksTabSeparated("tracks_tsv.txt", tracks, names);
-
-  //// Write separate values out
-  //ofstream names("names.txt");
-  //ofstream bpms("bpms.txt");
-  //ofstream keys("keys.txt");
-  //for (auto t : tracks) {
-  //  names << t.name           << endl;
-  //  bpms  << t.bpm            << endl;
-  //  keys  << t.key.short_name << endl;
-  //}
-  //names.close();
-  //bpms.close();
-  //keys.close();
-
-  // Collect stats on how many tracks are in which keys
-  KeyCount key_counts;
-  for (auto t : tracks) {
-    //key_counts[t.key].push_back(t);
-    key_counts[t.key]++;
+  string library_path = "tracks_tsv.txt";
+  string trace_path;
+  string front_path;
+  size_t alternatives_count = 0;
+  size_t parts = 0;
+  double diversity = kDefaultDiversity;
+  string socket_path;
+  size_t threads = 0;
+  SolveOptions options;
+  options.solver = kSolverExhaustive;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string arg = argv[i];
+    string val = argv[i+1];
+    if (arg == "--library") {
+      library_path = val;
+    } else if (arg == "--solver" && (val == "ant" || val == "exhaustive" || val == "bottleneck" || val == "horizon")) {
+      options.solver =
+        val == "ant" ? kSolverAnt :
+        val == "exhaustive" ? kSolverExhaustive :
+        val == "bottleneck" ? kSolverBottleneck :
+        kSolverHorizon;
+    } else if (arg == "--runs") {
+      options.runs = atoi(val.c_str());
+    } else if (arg == "--seed") {
+      options.seed = strtoul(val.c_str(), nullptr, 10);
+    } else if (arg == "--trace") {
+      trace_path = val;
+    } else if (arg == "--front") {
+      front_path = val;
+    } else if (arg == "--alternatives") {
+      alternatives_count = atoi(val.c_str());
+    } else if (arg == "--diversity") {
+      diversity = atof(val.c_str());
+    } else if (arg == "--window") {
+      options.window = atoi(val.c_str());
+    } else if (arg == "--commit") {
+      options.commit = atoi(val.c_str());
+    } else if (arg == "--partition") {
+      parts = atoi(val.c_str());
+    } else if (arg == "--serve") {
+      socket_path = val;
+    } else if (arg == "--cost" && (val == "transition" || val == "shift")) {
+      options.cost = val == "transition" ? kCostTransition : kCostKeyShift;
+    } else if (arg == "--aggregate" && (val == "sum" || val == "max")) {
+      options.aggregate = val == "sum" ? kAggregateSum : kAggregateMax;
+    } else if (arg == "--threads") {
+      threads = atoi(val.c_str());
+    } else {
+      cerr << "Unknown option " << arg << " " << val << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!socket_path.empty()) {
+    MixServer server(threads);
+    bool served = server.Serve(socket_path);
+    Logger::Flush();
+    return served ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
-  // Write the key counts
-  for (auto k : key_counts) {
+  Engine engine;
+  engine.Load(library_path);
+  Library const& library = engine.GetLibrary();
+
+  // Write stats on how many tracks are in which keys
+  for (auto k : library.GetKeyCounts()) {
     cout << Key::GetShortName(k.first.num, k.first.type) << ": " << k.second << endl;
   }
 
-  // Exhaustive solution
-  // Start at each track and try to get as many tracks into a mix as possible
-  // We will exhaustively try to join into each possible next track that is compatible
-  Tracks available = tracks;
-  Tracks best;
-  double best_cost = DBL_MAX;
-  for (size_t i = 0; i < available.size(); ++i) {
-    Tracks chosen;
-    Tracks this_best;
-    double cost = 0;
-    double this_best_cost = DBL_MAX;
-
-    int its = 0;
-    Tracks now_available = available;
-    Track t = now_available[i];
-    now_available.erase(now_available.begin() + i);
-    Tracks now_chosen = chosen;
-    now_chosen.push_back(t);
-    cout << "Starting with " << names[t.idx] << endl;
-    ChooseTrack(names, now_available, now_chosen, t.idx, t.key, t.bpm, cost, this_best_cost, kMixSongLen, this_best, its);
-
-    if (this_best.size() > best.size()) {
-      best = this_best;
-      cout << "New OVERALL best of " << best.size() << " found!" << endl;
-    }
-    else if (this_best.size() == best.size() && this_best_cost < best_cost) {
-      best_cost = this_best_cost;
-      best = this_best;
-      cout << "New OVERALL best cost of " << best_cost << " found!" << endl;
-    }
+  ConvergenceTrace trace;
+  if (!trace_path.empty()) {
+    options.trace = &trace;
   }
 
-  // Show our results
-  for (auto t : best) {
-    cout
-      << setw(3) << Key::GetShortName(t.key.num, t.key.type) << " @ "
-      << setw(3) << static_cast<int>(t.bpm) << "bpm"
-      << ", " << names[t.idx] << endl;
+  ParetoArchive front;
+  if (!front_path.empty()) {
+    options.front = &front;
   }
-  cout << "Cost is " << best_cost << endl;
 
-  return EXIT_SUCCESS;
+  DiverseMixes alternatives(alternatives_count, diversity);
+  if (alternatives_count > 0) {
+    options.alternatives = &alternatives;
+  }
 
-  //// Sort by BPM
-  //sort(tracks.begin(), tracks.end(), [](Track const& a, Track const& b)
-  //{
-  //  return a.bpm < b.bpm;
-  //});
-
-  //// Interactive selection
-  //vector<Track> order;
-  //int idx = 0;
-
-  //for (;;) {
-
-  //  // Mark our work
-  //  Track selected = tracks[idx];
-  //  tracks.erase(tracks.begin() + idx);
-  //  order.push_back(selected);
-
-  //  cout << "Your current track: " << selected.name << endl;
-
-  //  // Get options...
-  //  vector<TrackOption> options;
-  //  for (size_t i = 0; i < tracks.size(); ++i) {
-  //    // Must be compatible
-  //    if (!AreCompatibleKeys(selected.key, tracks[i].key)) {
-  //      continue;
-  //    }
-
-  //    // Get the BPM ratio
-  //    double bpm_ratio = max(selected.bpm, tracks[i].bpm) / min(selected.bpm, tracks[i].bpm);
-  //    //double bpm_ratio_st = log(bpm_ratio) / log(Utils::GetSemitoneRatio());
-
-  //    // We have an option
-  //    TrackOption option(tracks[i], bpm_ratio, i);
-  //    options.push_back(option);
-  //  }
-
-  //  // Sort by BPM ratio
-  //  sort(options.begin(), options.end(), [](TrackOption const& a, TrackOption const& b) 
-  //  {
-  //    return a.bpm_ratio < b.bpm_ratio;
-  //  }
-  //  );
-
-  //  // Print options
-  //  cout << "Options: " << endl;
-  //  for (size_t i = 0; i < options.size(); ++i) {
-  //    cout << i << "\t" << fixed << setw(4) << options[i].bpm_ratio << "\t" << options[i].track.name << " (" << options[i].track.key.short_name << ")" << endl;
-  //  }
-
-  //  cout << "You have selected " << order.size() << " tracks" << endl;
-
-  //  string choice;
-  //  getline(cin, choice);
-
-  //  if (!choice.compare("q")) {
-  //    break;
-  //  }
-
-  //  stringstream ss(choice);
-  //  ss >> idx;
-  //  idx = options[idx].idx;
-  //}
-
-  //// Write our order
-  //ofstream order_f("order.txt");
-  //for (auto t : order) {
-  //  order_f << t.bpm << "\t" << t.name << " (" << t.key.short_name << ")" << endl;
-  //}
-  //order_f.close();
-
-  //// Start by just choosing a base track (try each one)
-  //vector<Tracks> options;
-  //// Our starting track
-  //for (auto t : tracks) {
-  //  cout << "Starting with " << t.name << endl;
-  //  Tracks order;
-  //  if (ChooseTrack(t, tracks, order)) {
-  //    options.push_back(order);
-  //    cout << "Found " << options.size() << " solutions!" << endl;
-  //  }
-  //}
-
-  //// Select a key ordering
-  //vector<Keys> options;
-  //int max_depth = 0;
-  //for (auto k : key_counts) {
-  //  cout << "Starting with " << k.first.short_name << endl;
-  //  Keys order;
-  //  if (ChooseKey(KeyFromString("Dbm") /*k.first*/, key_counts, order, 1, max_depth)) {
-  //    options.push_back(order);
-  //    cout << "Found " << options.size() << " solutions!" << endl;
-  //  }
-  //}
-
-  // Find a mix that works!
-  MixAnt ma;
-  Mix m = ma.FindMix(tracks);
-
-  // Print the mix
-  //cout << m << endl;
-
-  cout << "Mix uses " << m.steps.size() << " of " << tracks.size() << " input tracks" << endl << endl;
-
-  // Save the mix to a file
-  ofstream ofs("mix.txt");
-  ofs << m;
-  ofs.close();
-
-  // write our unused tracks
-  Tracks unused(tracks);
-  for (auto s : m.steps) {
-    for (auto it = unused.begin(); it != unused.end(); ++it) {
-      if (*it == s.track) {
-        unused.erase(it);
-        break;
-      }
+  if (parts > 0) {
+    options.threads = threads;
+    Mix all;
+    auto mixes = engine.Partition(parts, options);
+    Logger::Flush();
+    for (size_t i = 0; i < mixes.size(); ++i) {
+      cout << "Mix " << i+1 << " of " << mixes.size() << endl;
+      PrintMix(mixes[i], library.GetNames());
+      cout << endl;
+      all.steps.insert(all.steps.end(), mixes[i].steps.begin(), mixes[i].steps.end());
     }
+    WriteUnused("unused.txt", library.GetTracks(), all);
   }
-    
-  ofstream unused_f("unused.txt");
-  for (auto u : unused) {
-    //unused_f << u.name << endl;
-    //unused_f << u.key.short_name << endl;
-    unused_f << u.bpm << endl;
+  else if (options.solver != kSolverAnt) {
+    Mix m = engine.Solve(options);
+    Logger::Flush();
+    PrintMix(m, library.GetNames());
+  }
+  else {
+    // A cached mix doesn't come with a front or alternatives
+    Mix m = front_path.empty() && alternatives_count == 0 ? SolveCached(engine, options) : engine.Solve(options);
+
+    // Work out the tempo ramps for the whole mix at once
+    TempoPlanner planner;
+    double residual = planner.Plan(m);
+    Logger::Flush();
+    cout << "Tempo plan leaves " << residual << " semitones of tuning" << endl;
+    cout << "Mix uses " << m.steps.size() << " of " << library.GetTracks().size() << " input tracks" << endl << endl;
+
+    // Save the mix to a file
+    METRIC_TIME(kTimeOutput);
+    ofstream ofs("mix.txt");
+    ofs << m;
+    ofs.close();
+
+    WriteUnused("unused.txt", library.GetTracks(), m);
   }
-  unused_f.close();
 
-  //cin.get();
-}
\ No newline at end of file
+  if (!front_path.empty()) {
+    WriteFront(front_path, front, library.GetNames());
+  }
+  if (alternatives_count > 0) {
+    WriteAlternatives("alternatives.txt", alternatives, library.GetNames());
+  }
+
+  if (!trace_path.empty()) {
+    trace.Write(trace_path);
+  }
+
+  METRIC_WRITE("metrics.json");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "metrics.h"
+
+static char const* kCounterNames[kNumCounters] = {
+  "candidates_scanned",
+  "candidates_usable",
+  "nodes_expanded",
+  "nodes_pruned",
+  "restarts",
+  "improvements"
+};
+
+static char const* kTimerNames[kNumTimers] = {
+  "parse",
+  "distances",
+  "search",
+  "output"
+};
+
+struct ImprovementEvent
+{
+  double time;
+  size_t length;
+  double cost;
+};
+
+struct MetricsSnapshot
+{
+  MetricsSnapshot()
+  {
+    Clear();
+  }
+
+  void Clear()
+  {
+    for (int i = 0; i < kNumCounters; ++i) {
+      counters[i] = 0;
+    }
+    for (int i = 0; i < kNumTimers; ++i) {
+      timers[i] = 0;
+    }
+    improvements.clear();
+  }
+
+  void MergeInto(MetricsSnapshot& total) const
+  {
+    for (int i = 0; i < kNumCounters; ++i) {
+      total.counters[i] += counters[i];
+    }
+    for (int i = 0; i < kNumTimers; ++i) {
+      total.timers[i] += timers[i];
+    }
+    total.improvements.insert(total.improvements.end(), improvements.begin(), improvements.end());
+  }
+
+  long long                     counters[kNumCounters];
+  double                        timers[kNumTimers];
+  std::vector<ImprovementEvent> improvements;
+};
+
+static std::mutex merge_mutex;
+static MetricsSnapshot merged;
+static std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+
+// Folds itself into the merged totals when its thread exits
+struct ThreadMetrics : public MetricsSnapshot
+{
+  ~ThreadMetrics()
+  {
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    MergeInto(merged);
+  }
+};
+
+static thread_local ThreadMetrics local;
+
+void Metrics::Count(Counter counter, long long n)
+{
+  local.counters[counter] += n;
+}
+
+void Metrics::AddTime(Timer timer, double seconds)
+{
+  local.timers[timer] += seconds;
+}
+
+void Metrics::Improvement(size_t length, double cost)
+{
+  ImprovementEvent e = { Elapsed(), length, cost };
+  local.improvements.push_back(e);
+  local.counters[kImprovements]++;
+}
+
+double Metrics::Elapsed()
+{
+  using namespace std::chrono;
+  return duration_cast<duration<double> >(steady_clock::now() - start).count();
+}
+
+void Metrics::Flush()
+{
+  std::lock_guard<std::mutex> lock(merge_mutex);
+  local.MergeInto(merged);
+  local.Clear();
+}
+
+bool Metrics::Write(std::string const& path)
+{
+  MetricsSnapshot total;
+  {
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    merged.MergeInto(total);
+  }
+  local.MergeInto(total);
+
+  std::ofstream ofs(path);
+  if (!ofs) {
+    return false;
+  }
+
+  double scanned = static_cast<double>(total.counters[kCandidatesScanned]);
+  double usable_ratio = scanned > 0 ? total.counters[kCandidatesUsable] / scanned : 0;
+
+  bool prometheus = path.size() >= 5 && !path.compare(path.size() - 5, 5, ".prom");
+  if (prometheus) {
+    for (int i = 0; i < kNumCounters; ++i) {
+      ofs << "# TYPE mixant_" << kCounterNames[i] << "_total counter" << std::endl;
+      ofs << "mixant_" << kCounterNames[i] << "_total " << total.counters[i] << std::endl;
+    }
+    ofs << "# TYPE mixant_usable_ratio gauge" << std::endl;
+    ofs << "mixant_usable_ratio " << usable_ratio << std::endl;
+    ofs << "# TYPE mixant_seconds_total counter" << std::endl;
+    for (int i = 0; i < kNumTimers; ++i) {
+      ofs << "mixant_seconds_total{phase=\"" << kTimerNames[i] << "\"} " << total.timers[i] << std::endl;
+    }
+    if (!total.improvements.empty()) {
+      ImprovementEvent const& last = total.improvements.back();
+      ofs << "# TYPE mixant_best_length gauge" << std::endl;
+      ofs << "mixant_best_length " << last.length << std::endl;
+      ofs << "# TYPE mixant_best_cost gauge" << std::endl;
+      ofs << "mixant_best_cost " << last.cost << std::endl;
+    }
+    return true;
+  }
+
+  ofs << "{" << std::endl << "  \"counters\": {" << std::endl;
+  for (int i = 0; i < kNumCounters; ++i) {
+    ofs << "    \"" << kCounterNames[i] << "\": " << total.counters[i] << "," << std::endl;
+  }
+  ofs << "    \"usable_ratio\": " << usable_ratio << std::endl << "  }," << std::endl;
+
+  ofs << "  \"seconds\": {" << std::endl;
+  for (int i = 0; i < kNumTimers; ++i) {
+    ofs << "    \"" << kTimerNames[i] << "\": " << total.timers[i] << (i + 1 < kNumTimers ? "," : "") << std::endl;
+  }
+  ofs << "  }," << std::endl;
+
+  ofs << "  \"improvements\": [" << std::endl;
+  for (size_t i = 0; i < total.improvements.size(); ++i) {
+    ImprovementEvent const& e = total.improvements[i];
+    ofs << "    { \"time\": " << e.time << ", \"length\": " << e.length << ", \"cost\": " << e.cost << " }"
+        << (i + 1 < total.improvements.size() ? "," : "") << std::endl;
+  }
+  ofs << "  ]" << std::endl << "}" << std::endl;
+  return true;
+}
+
+void Metrics::Reset()
+{
+  std::lock_guard<std::mutex> lock(merge_mutex);
+  merged.Clear();
+  local.Clear();
+}
+
+ScopedTimer::ScopedTimer(Timer timer) : timer(timer), beg(Metrics::Elapsed())
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+  Metrics::AddTime(timer, Metrics::Elapsed() - beg);
+}
@@ -0,0 +1,84 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+
+// Counters and timers for the hot paths
+// Define MIXANT_METRICS to turn them on -- otherwise the macros below compile
+// to nothing and the solvers don't pay for them at all
+// Each thread counts into its own accumulators, which are merged when the
+// thread exits (or when the snapshot is written, for the calling thread)
+// Threads that never exit, like a server's pool, merge theirs with Flush
+
+enum Counter
+{
+  kCandidatesScanned,
+  kCandidatesUsable,
+  kNodesExpanded,
+  kNodesPruned,
+  kRestarts,
+  kImprovements,
+  kNumCounters
+};
+
+enum Timer
+{
+  kTimeParse,
+  kTimeDistances,
+  kTimeSearch,
+  kTimeOutput,
+  kNumTimers
+};
+
+class Metrics
+{
+public:
+
+  static void Count(Counter counter, long long n = 1);
+  static void AddTime(Timer timer, double seconds);
+
+  // Remembers when a solver found a better mix, and how good it was
+  static void Improvement(size_t length, double cost);
+
+  // Seconds since the program started
+  static double Elapsed();
+
+  // Merges the calling thread's counts now rather than when it exits
+  static void Flush();
+
+  // Writes everything merged so far (plus the calling thread's counts)
+  // A path ending in .prom gets Prometheus text format, otherwise JSON
+  static bool Write(std::string const& path);
+
+  static void Reset();
+};
+
+// Adds the time spent in a scope to a timer
+class ScopedTimer
+{
+public:
+
+  ScopedTimer(Timer timer);
+  ~ScopedTimer();
+
+protected:
+
+  Timer  timer;
+  double beg;
+};
+
+#ifdef MIXANT_METRICS
+#define METRIC_COUNT(counter, n)        Metrics::Count(counter, n)
+#define METRIC_TIME(timer)              ScopedTimer metric_timer_##timer(timer)
+#define METRIC_IMPROVEMENT(length, cost) Metrics::Improvement(length, cost)
+#define METRIC_WRITE(path)              Metrics::Write(path)
+#define METRIC_FLUSH()                  Metrics::Flush()
+#else
+#define METRIC_COUNT(counter, n)
+#define METRIC_TIME(timer)
+#define METRIC_IMPROVEMENT(length, cost)
+#define METRIC_WRITE(path)
+#define METRIC_FLUSH()
+#endif
+
+#endif
@@ -1,7 +1,9 @@
 #include "mix.h"
 #include "mixant.h"
+#include "transition.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <string>
 
 MixStep::MixStep(Track const& track) : track(track), bpm_beg(track.bpm), bpm_end(track.bpm), play_key(track.key), tuning(0)
@@ -42,17 +44,122 @@ std::ostream& operator<<(std::ostream& out, const Mix& mix)
   return out;
 }
 
-double Mix::CalculateDistance()
+Mix::Mix() : total_cost(0), max_cost(0), max_dirty(false)
+{
+}
+
+// The transition into a step depends on how the previous step is played
+double Mix::FindEdgeCost(size_t pos) const
 {
-  if (steps.size() <= 1) {
+  if (pos == 0) {
     return 0;
   }
+  MixStep const& prv = steps[pos-1];
+  MixStep const& cur = steps[pos];
+  return MixAnt::FindTransitionCost(
+    prv.track.log_bpm - cur.track.log_bpm,
+    TransitionTable::Get(prv.GetPlayKey(), cur.track.key).transpose
+    );
+}
+
+void Mix::SetEdgeCost(size_t pos, double cost)
+{
+  double old_cost = edge_costs[pos];
+  edge_costs[pos] = cost;
+  total_cost += cost - old_cost;
+
+  // Only a shrinking maximum forces us to look at everything again
+  if (cost >= max_cost) {
+    max_cost = cost;
+  } else if (old_cost >= max_cost) {
+    max_dirty = true;
+  }
+}
+
+void Mix::AddStep(MixStep const& step)
+{
+  InsertStep(steps.size(), step);
+}
+
+void Mix::InsertStep(size_t pos, MixStep const& step)
+{
+  steps.insert(steps.begin() + pos, step);
+  edge_costs.insert(edge_costs.begin() + pos, 0);
+
+  SetEdgeCost(pos, FindEdgeCost(pos));
+  if (pos + 1 < steps.size()) {
+    SetEdgeCost(pos + 1, FindEdgeCost(pos + 1));
+  }
+}
+
+void Mix::RemoveStep(size_t pos)
+{
+  SetEdgeCost(pos, 0);
+  if (pos + 1 < steps.size()) {
+    SetEdgeCost(pos + 1, 0);
+  }
+
+  steps.erase(steps.begin() + pos);
+  edge_costs.erase(edge_costs.begin() + pos);
+
+  if (pos < steps.size()) {
+    SetEdgeCost(pos, FindEdgeCost(pos));
+  }
+}
 
+void Mix::SetPlayKey(size_t pos, Key const& key)
+{
+  steps[pos].SetPlayKey(key);
+  if (pos + 1 < steps.size()) {
+    SetEdgeCost(pos + 1, FindEdgeCost(pos + 1));
+  }
+}
+
+double Mix::CalculateDistance()
+{
   // Walk through all the tracks, calculating the sum of distances along the way
-  double dist = 0;
+  edge_costs.assign(steps.size(), 0);
+  total_cost = 0;
+  max_cost = 0;
+  max_dirty = false;
   for (size_t i = 1; i < steps.size(); ++i) {
-    dist += MixAnt::FindTrackDistance(steps[i-1].track, steps[i].track);
+    SetEdgeCost(i, FindEdgeCost(i));
+  }
+
+  return total_cost;
+}
+
+double Mix::GetTotalCost() const
+{
+  return total_cost;
+}
+
+double Mix::GetMaxCost() const
+{
+  if (max_dirty) {
+    max_cost = edge_costs.empty() ? 0 : *std::max_element(edge_costs.begin(), edge_costs.end());
+    max_dirty = false;
+  }
+  return max_cost;
+}
+
+double Mix::GetMeanCost() const
+{
+  return steps.size() <= 1 ? 0 : total_cost / (steps.size() - 1);
+}
+
+std::vector<double> const& Mix::GetEdgeCosts() const
+{
+  return edge_costs;
+}
+
+bool Mix::CanBeat(size_t best_len, double best_cost, size_t remaining) const
+{
+  size_t max_len = steps.size() + remaining;
+  if (max_len != best_len) {
+    return max_len > best_len;
   }
 
-  return dist;
+  // Costs never go negative, so we can only get more expensive from here
+  return total_cost < best_cost;
 }
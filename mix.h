@@ -27,13 +27,45 @@ protected:
 
 typedef std::vector<MixStep> MixSteps;
 
+// Edge costs are kept up to date as steps are added, inserted, removed or
+// re-keyed through the methods below
+// If you change steps directly, CalculateDistance brings everything back in sync
 struct Mix
 {
+  Mix();
+
+  void AddStep(MixStep const& step);
+  void InsertStep(size_t pos, MixStep const& step);
+  void RemoveStep(size_t pos);
+  void SetPlayKey(size_t pos, Key const& key);
+
+  // Rescores every transition from scratch
   double CalculateDistance();
 
+  double GetTotalCost() const;
+  double GetMaxCost() const;
+  double GetMeanCost() const;
+
+  // Cost of the transition INTO each step, so the first is always zero
+  std::vector<double> const& GetEdgeCosts() const;
+
+  // Could this mix still beat an incumbent (longest first, then cheapest) if
+  // it were extended by up to remaining more steps?
+  bool CanBeat(size_t best_len, double best_cost, size_t remaining) const;
+
   MixSteps steps;
 
   friend std::ostream& operator<<(std::ostream& out, const Mix& mix);
+
+protected:
+
+  double FindEdgeCost(size_t pos) const;
+  void   SetEdgeCost(size_t pos, double cost);
+
+  std::vector<double> edge_costs;
+  double              total_cost;
+  mutable double      max_cost;
+  mutable bool        max_dirty;
 };
 
 #endif
\ No newline at end of file
@@ -1,12 +1,72 @@
 #include <algorithm>
+#include <chrono>
 #include <ctime>
+#include <deque>
 #include <iostream>
 #include <random>
 
+#include "compact.h"
+#include "logger.h"
+#include "metrics.h"
 #include "mixant.h"
+#include "transition.h"
 #include "utils.h"
 
-static std::tr1::mt19937 eng;
+static double Now()
+{
+  using namespace std::chrono;
+  return duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+// As Mix::CanBeat, for a mix of len tracks costing cost so far
+static bool CanBeat(size_t len, double cost, size_t remaining, size_t best_len, double best_cost)
+{
+  size_t max_len = len + remaining;
+  if (max_len != best_len) {
+    return max_len > best_len;
+  }
+  return cost < best_cost;
+}
+
+MixAnt::MixAnt() : graph(nullptr), cost(kCostDefault), aggregate(kAggregateSum), front(nullptr), alternatives(nullptr), trace(nullptr), budget(0)
+{
+}
+
+void MixAnt::SetGraph(CompatibilityGraph const* graph)
+{
+  this->graph = graph;
+}
+
+void MixAnt::SetCost(CostModel cost, CostAggregate aggregate)
+{
+  this->cost = cost;
+  this->aggregate = aggregate;
+}
+
+void MixAnt::SetFront(ParetoArchive* front)
+{
+  this->front = front;
+}
+
+void MixAnt::SetAlternatives(DiverseMixes* alternatives)
+{
+  this->alternatives = alternatives;
+}
+
+void MixAnt::SetTrace(ConvergenceTrace* trace)
+{
+  this->trace = trace;
+}
+
+void MixAnt::Seed(unsigned long seed)
+{
+  eng.seed(seed);
+}
+
+void MixAnt::SetBudget(double seconds)
+{
+  budget = seconds;
+}
 
 double MixAnt::FindDistance(
   double bpm_a,
@@ -22,25 +82,15 @@ double MixAnt::FindDistance(
   double bpm_ratio    = bpm_a / bpm_b;
   double bpm_ratio_st = log(bpm_ratio) / log(Utils::GetSemitoneRatio());
 
-  // How far must we transpose the "second" track to make it compatible with the "first"?
-  int min_transpose_dist = INT_MAX;
-  Keys compatible;
-  Key::GetCompatibleKeys(key_a, compatible);
-  for (auto k : compatible) {
-    // Only care about keys compatible with "first", and ones of the same type as our "second" track
-    if (k.type != key_b.type) {
-      continue;
-    }
-    int transpose_dist = Key::GetTransposeDistance(key_b, k);
-    if (abs(transpose_dist) < abs(min_transpose_dist)) {
-      min_transpose_dist = transpose_dist;
-    }
-  }
+  return FindTransitionCost(bpm_ratio_st, FindTranspose(key_a, key_b));
+}
 
-  double bpm_dist = bpm_ratio_st;
-  double key_dist = min_transpose_dist;
-  double tuning_dist = bpm_dist - key_dist;
-  return abs(tuning_dist) + std::max(abs(bpm_dist), abs(key_dist));
+int MixAnt::FindTranspose(
+  Key const& key_a,
+  Key const& key_b
+  )
+{
+  return TransitionTable::Get(key_a, key_b).transpose;
 }
 
 // Find distance from one track to another
@@ -63,148 +113,262 @@ Matrix MixAnt::FindTrackDistances(Tracks const& tracks)
     i->resize(tracks.size());
   }
 
+  // Distances are directional, so we need both halves
   for (size_t i = 0; i < tracks.size(); ++i) {
-    for (size_t j = i+1; j < tracks.size(); ++j) {
-      
-      double total_dist = MixAnt::FindTrackDistance(tracks[i], tracks[j]); 
-
-      dists[i][j] = total_dist;
-      dists[j][i] = total_dist;
+    for (size_t j = 0; j < tracks.size(); ++j) {
+      dists[i][j] = i == j ? 0 : MixAnt::FindTrackDistance(tracks[i], tracks[j]);
     }
   }
   return dists;
 }
 
-Mix MixAnt::FindMix(Tracks const& tracks)
+Key MixAnt::ChoosePlayKey(
+  Key const& prev_play,
+  Key const& natural
+  )
+{
+  return Key::GetKeys()[TransitionTable::Get(prev_play, natural).play_key];
+}
+
+Mix MixAnt::FindMix(Tracks const& tracks, Mix const* seed, int runs, size_t stop_chain)
 {
   //eng.seed(static_cast<unsigned long>(time(NULL)));
 
-  Mix best_mix;
+  // Without a shared graph, build one just for this call
+  CompatibilityGraph own_graph;
+  CompatibilityGraph const* graph = this->graph;
+  if (!graph) {
+    own_graph.Build(tracks, kRuleDistance, cost);
+    graph = &own_graph;
+  }
+
+  typedef Mix (MixAnt::*Finder)(Tracks const&, CompatibilityGraph const&, Mix const*, int, size_t);
+
+  // Indexed by CostAggregate
+  static Finder const kFinders[] = {
+    &MixAnt::FindMixWith<SumCost>,
+    &MixAnt::FindMixWith<MaxCost>
+  };
+
+  return (this->*kFinders[aggregate])(tracks, *graph, seed, runs, stop_chain);
+}
+
+// Mix costs come from the graph's edges, added up as Aggregate says
+template <typename Aggregate>
+Mix MixAnt::FindMixWith(
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  Mix const* seed,
+  int runs,
+  size_t stop_chain
+  )
+{
+  METRIC_TIME(kTimeSearch);
+
+  // Only keep the compact form of the best so improvements are cheap to take
+  CompactMix best_mix;
   double best_dist = DBL_MAX;
   size_t best_chain = 0;
 
-  // Do a whole bunch of runs
-  for (size_t r = 0; r < kMixRuns; ++r) {
+  // A seed mix is our incumbent, so we only need to find something better
+  if (seed && !seed->steps.empty()) {
+    Mix seed_mix(*seed);
+    best_chain = seed_mix.steps.size();
+    seed_mix.CalculateDistance();
+    best_dist = Aggregate::Of(seed_mix);
+    best_mix = CompactMix::FromMix(seed_mix);
+    LOG(kLogInfo) << "Seeded with mix of length " << best_chain << " with total distance " << best_dist;
+    if (trace) {
+      trace->Record(best_chain, best_dist);
+    }
+  }
 
-    std::cout << "Run " << r+1 << " of " << kMixRuns << std::endl;
+  double deadline = budget > 0 ? Now() + budget : DBL_MAX;
+
+  // Mixes grow at both ends: on from the last track, and back from the first
+  // through the graph's edges run backwards
+  // The first track always plays in its own key, so putting another in front
+  // of it never changes the key (or the cost) of anything after
+  std::vector<size_t> lead_offsets;
+  std::vector<GraphEdge> lead_ins;
+  graph.FindLeadIns(lead_offsets, lead_ins);
+
+  // A seed also guides construction: where the seed played one track
+  // straight after another, we mostly do too, so warm-started walks rebuild
+  // the seed's good stretches rather than hoping to stumble on them
+  std::vector<int> seed_next;
+  std::vector<int> seed_prev;
+  if (seed && !seed->steps.empty()) {
+    seed_next.assign(tracks.size(), -1);
+    seed_prev.assign(tracks.size(), -1);
+    for (size_t s = 1; s < seed->steps.size(); ++s) {
+      seed_next[seed->steps[s-1].track.idx] = seed->steps[s].track.idx;
+      seed_prev[seed->steps[s].track.idx] = seed->steps[s-1].track.idx;
+    }
+  }
+  std::tr1::uniform_int<> rnd_follow(0, 99);
+
+  std::vector<unsigned int> used(tracks.size());
+  unsigned int stamp = 0;
+  std::vector<GraphEdge const*> usable;
+  std::vector<size_t> guided;
+  std::deque<int> nodes;
+
+  // The mix played through nodes, each track ending at the next one's tempo
+  auto pack = [&]()
+  {
+    CompactMix mix;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      Track const& t = tracks[graph.GetTrack(nodes[n])];
+      double bpm_end = n + 1 < nodes.size() ? tracks[graph.GetTrack(nodes[n+1])].bpm : t.bpm;
+      mix.Push(t.idx, graph.GetKey(nodes[n]), t.bpm, bpm_end);
+    }
+    return mix;
+  };
 
-    // Try each starting track
-    for (size_t i = 0; i < tracks.size(); ++i) {
+  // Do a whole bunch of runs
+  double last_progress = 0;
+  for (int r = 0; r < runs && best_chain < stop_chain; ++r) {
 
-      // The mix starting with this track
-      Mix m;
-      MixStep cur_ms(tracks[i]);
-      MixStep prv_ms(tracks[i]);
-      size_t chain = 1;
+    if (Logger::Due(last_progress, kProgressInterval)) {
+      LOG(kLogInfo) << "Run " << r+1 << " of " << runs;
+    }
 
-      //std::cout << "Trying " << tracks[i].name << " as start..." << std::endl;
+    // Try each starting track
+    for (size_t i = 0; i < tracks.size() && best_chain < stop_chain; ++i) {
 
-      TrackOrder available;
-      available.reserve(tracks.size()-1);
-      for (size_t j = 0; j < tracks.size(); ++j) {
-        if (j == i) {
-          continue;
-        }
-        available.push_back(TrackSpot(&tracks[j], j));
+      if (deadline < DBL_MAX && Now() > deadline) {
+        LOG(kLogDebug) << "Out of time after " << r << " runs";
+        return best_mix.Materialize(tracks);
       }
 
-      // Choose the next track
-      while (!available.empty()) {
+      METRIC_COUNT(kRestarts, 1);
 
-        // Collect all tracks that are within a threshold distance
-        // Need to calculate distance to all available tracks
-        TrackOrder usable;
-        std::vector<double> dists;
-        dists.resize(available.size());
+      // The mix grown out from this track
+      nodes.assign(1, graph.GetStartNode(i));
+      double dist = 0;
+      double total = 0;
+      double worst = 0;
 
-        for (size_t k = 0; k < dists.size(); ++k) {
-          dists[k] = MixAnt::FindDistance(prv_ms.bpm_beg, available[k].track->bpm, prv_ms.GetPlayKey(), available[k].track->key);
-          if (dists[k] < kDistThreshold) {
-            usable.push_back(available[k]);
+      // Tracks used in this mix are marked with this start's stamp
+      if (++stamp == 0) {
+        std::fill(used.begin(), used.end(), 0);
+        stamp = 1;
+      }
+      used[i] = stamp;
+      size_t available = tracks.size() - 1;
+
+      // Choose the next track, at either end
+      while (available > 0) {
+
+        // Collect all unused tracks that are within a threshold distance of
+        // the last track, then all that could come before the first
+        int tail = nodes.back();
+        int head = graph.GetTrack(nodes.front());
+        // (noting any the seed played next to them)
+        int tail_next = seed_next.empty() ? -1 : seed_next[graph.GetTrack(tail)];
+        int head_prev = seed_prev.empty() ? -1 : seed_prev[head];
+        usable.clear();
+        guided.clear();
+        for (auto e = graph.EdgesBegin(tail); e != graph.EdgesEnd(tail); ++e) {
+          int t = graph.GetTrack(e->node);
+          if (used[t] != stamp) {
+            if (t == tail_next) {
+              guided.push_back(usable.size());
+            }
+            usable.push_back(e);
           }
         }
+        size_t at_tail = usable.size();
+        GraphEdge const* lead_beg = lead_ins.data() + lead_offsets[head];
+        GraphEdge const* lead_end = lead_ins.data() + lead_offsets[head+1];
+        for (auto e = lead_beg; e != lead_end; ++e) {
+          int t = graph.GetTrack(e->node);
+          if (used[t] != stamp) {
+            if (t == head_prev) {
+              guided.push_back(usable.size());
+            }
+            usable.push_back(e);
+          }
+        }
+
+        size_t scanned = graph.GetDegree(tail) + (lead_end - lead_beg);
+        METRIC_COUNT(kCandidatesScanned, scanned);
+        if (trace) {
+          trace->Count(scanned);
+        }
+        METRIC_COUNT(kCandidatesUsable, usable.size());
 
-        // We've run out of usable tracks, so we need a hard break
-        // We'll choose a random track to continue with
+        // We've run out of usable tracks at both ends, so we need a hard break
         if (usable.empty()) {
-          //std::cout << "End of chain reached -- no more usable tracks" << std::endl;
           break;
         }
 
-        // We've added another track
-        ++chain;
-
-        // We have our starting track, so now randomly pick a second one that falls under a distance threshold
-        std::tr1::uniform_int<> rnd_usable(0, usable.size() - 1);
-        int use_idx = rnd_usable(eng);
-
-        // Create our current mix step, and adjust it to match the previous
-        cur_ms = MixStep(*usable[use_idx].track);
-
-        // Adjust previous track to end at this BPM
-        prv_ms.bpm_end = cur_ms.bpm_beg;
-
-        // Is the current track compatible with the previous?
-        bool compatible = Key::AreCompatibleKeys(cur_ms.track.key, prv_ms.GetPlayKey());
-
-        // We're done if we're already compatible
-        if (compatible) {
-          goto next;
+        // Randomly pick one of them, wherever it goes (mostly following the
+        // seed where we can)
+        size_t pick;
+        if (!guided.empty() && rnd_follow(eng) < kSeedFollowPercent) {
+          std::tr1::uniform_int<> rnd_guided(0, guided.size() - 1);
+          pick = guided[rnd_guided(eng)];
+        } else {
+          std::tr1::uniform_int<> rnd_usable(0, usable.size() - 1);
+          pick = rnd_usable(eng);
         }
-
-        // We're not compatible, so we need a tuning change in the current track
-        // Choose the key with the smallest combined distance between previous and next
-        {
-          int min_dist = INT_MAX;
-          Keys compatible_keys;
-          Key::GetCompatibleKeys(prv_ms.GetPlayKey(), compatible_keys);
-          for (auto k : compatible_keys) {
-
-            // Can't switch between min-maj!
-            // And we only care about compatible keys
-            if (k.type != cur_ms.track.key.type) {
-              continue;
-            }
-
-            // Want the smallest distance between our natural key and the next one
-            int cur_dist = Key::GetTransposeDistance(cur_ms.track.key, k);
-            // Check the total distance -- want the best value
-            if (abs(cur_dist) <= min_dist) {
-              min_dist = abs(cur_dist);
-              cur_ms.SetPlayKey(k);
-            }
-          }
+        GraphEdge const& use = *usable[pick];
+        if (pick < at_tail) {
+          nodes.push_back(use.node);
+        } else {
+          nodes.push_front(use.node);
         }
 
-next:
-        for (auto it = available.begin(); it != available.end(); ++it) {
-          if (it->idx == usable[use_idx].idx) {
-            available.erase(it);
-            break;
-          }
+        used[graph.GetTrack(use.node)] = stamp;
+        --available;
+        dist = Aggregate::Add(dist, use.cost);
+        total += use.cost;
+        worst = std::max(worst, use.cost);
+
+        // Give up as soon as we can't be longer or cheaper than the best,
+        // unless growing could still get us onto the front or among the
+        // alternatives
+        if (!CanBeat(nodes.size(), dist, available, best_chain, best_dist) &&
+          (!front || !front->Accepts(nodes.size() + available, total, worst)) &&
+          (!alternatives || !alternatives->Accepts(nodes.size() + available, dist))) {
+          break;
         }
-        m.steps.push_back(prv_ms);
-        prv_ms = cur_ms;
       }
 
-      m.steps.push_back(cur_ms);
+      // Mixes that can't beat the best may still make the front, or be an
+      // alternative
+      size_t chain = nodes.size();
+      bool beats = CanBeat(chain, dist, 0, best_chain, best_dist);
+      if (!beats && !front && !alternatives) {
+        continue;
+      }
 
-      // How'd we do? Calculate the entire mix distance
-      if (chain >= best_chain) {
-        double dist = m.CalculateDistance();
+      if (front && front->Accepts(chain, total, worst)) {
+        front->Offer(chain, total, worst, pack());
+      }
+      if (alternatives && alternatives->Accepts(chain, dist)) {
+        alternatives->Offer(chain, dist, pack());
+      }
+      if (!beats) {
+        continue;
+      }
 
-        if (chain > best_chain || dist < best_dist) {
-          best_chain = chain;
-          best_dist = dist;
-          best_mix = m;
-          std::cout << "Found new best mix of length " << best_chain << " with total distance " << best_dist << std::endl;
-        }
+      // How'd we do?
+      best_chain = chain;
+      best_dist = dist;
+      best_mix = pack();
+      LOG(kLogInfo) << "Found new best mix of length " << best_chain << " with total distance " << best_dist;
+      METRIC_IMPROVEMENT(best_chain, best_dist);
+      if (trace) {
+        trace->Record(best_chain, best_dist);
       }
     }
 
   }
 
-  return best_mix;
+  return best_mix.Materialize(tracks);
 }
 
 //Mix MixAnt::FindMix(Tracks const& tracks)
@@ -1,7 +1,17 @@
 #ifndef MIXANT_H
 #define MIXANT_H
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "costs.h"
+#include "diverse.h"
+#include "graph.h"
 #include "mix.h"
+#include "pareto.h"
+#include "trace.h"
 #include "track.h"
 
 typedef std::vector< std::vector<double> > Matrix;
@@ -11,6 +21,13 @@ static const int kNumAnts = 1000;
 static const double kPheromoneDrop = 2.0 / kMixRuns;
 static const double kPheromonePop = 2 * kPheromoneDrop;
 static const double kDistThreshold = 2;
+static const double kBPMThresh = 0.3;
+static const int kKeyShiftThresh = 1;
+static const int kMixSongLen = 20;
+
+// How often (in percent) a warm-started FindMix follows its seed's next track
+// when it can
+static const int kSeedFollowPercent = 80;
 
 struct TrackSpot
 {
@@ -35,7 +52,42 @@ class MixAnt
 {
 public:
 
-  Mix FindMix(Tracks const& tracks);
+  MixAnt();
+
+  // Share a compatibility graph (kRuleDistance) already built for the tracks
+  // FindMix will be given, rather than building one every call
+  void SetGraph(CompatibilityGraph const* graph);
+
+  // How FindMix prices transitions (when it builds its own graph, as a shared
+  // graph comes with its own costs) and adds them up
+  void SetCost(CostModel cost, CostAggregate aggregate);
+
+  // Offer every mix FindMix builds to front (pass nullptr to stop), by its
+  // total and worst edge costs
+  void SetFront(ParetoArchive* front);
+
+  // Offer every mix FindMix builds to alternatives (pass nullptr to stop)
+  void SetAlternatives(DiverseMixes* alternatives);
+
+  // Record how the best mix improves in FindMix (pass nullptr to stop)
+  void SetTrace(ConvergenceTrace* trace);
+
+  // Each MixAnt has its own random engine, so separate MixAnts can solve on
+  // separate threads at the same time
+  void Seed(unsigned long seed);
+
+  // Caps how long each FindMix call may run (in seconds, 0 for no limit)
+  // The best mix found so far is returned when time runs out
+  void SetBudget(double seconds);
+
+  // Optionally seed the search with an existing mix (e.g. a cached result)
+  // The search stops early once it finds a chain of stop_chain tracks
+  Mix FindMix(
+    Tracks const& tracks,
+    Mix const* seed = nullptr,
+    int runs = kMixRuns,
+    size_t stop_chain = SIZE_MAX
+    );
   
   static double FindDistance(
     double bpm_a,
@@ -44,19 +96,59 @@ public:
     Key const& key_b
     );
 
+  // How far (in semitones) a track in key_b must be transposed to be
+  // compatible with key_a
+  static int FindTranspose(
+    Key const& key_a,
+    Key const& key_b
+    );
+
+  // The distance for a tempo change of bpm_dist and a transposition of
+  // key_dist (both in semitones)
+  static double FindTransitionCost(double bpm_dist, int key_dist)
+  {
+    return TransitionCost::Cost(bpm_dist, key_dist);
+  }
+
   static double FindTrackDistance(
     Track const& a,
     Track const& b
     );
 
+  // Key to play "natural" in so that it's compatible with the previous play key
+  static Key ChoosePlayKey(
+    Key const& prev_play,
+    Key const& natural
+    );
+
+  // Distance from every track (row) to every other track (column)
+  static Matrix FindTrackDistances(Tracks const& tracks);
+
 protected:
   
   //Mix MakeMix(TrackOrder const& order);
 
-  Matrix FindTrackDistances(Tracks const& tracks);
+  template <typename Aggregate>
+  Mix FindMixWith(
+    Tracks const& tracks,
+    CompatibilityGraph const& graph,
+    Mix const* seed,
+    int runs,
+    size_t stop_chain
+    );
 
   Matrix distances;
   Matrix pheromone;
+
+  CompatibilityGraph const* graph;
+  CostModel                 cost;
+  CostAggregate             aggregate;
+  ParetoArchive*            front;
+  DiverseMixes*             alternatives;
+  ConvergenceTrace*         trace;
+  double                    budget;
+
+  std::tr1::mt19937 eng;
 };
 
 #endif
\ No newline at end of file
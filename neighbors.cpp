@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include "mixant.h"
+#include "neighbors.h"
+#include "transition.h"
+
+void NeighborIndex::Build(Tracks const& tracks)
+{
+  this->tracks = tracks;
+  buckets.assign(Key::GetKeys().size(), Bucket());
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    Entry e = { tracks[i].log_bpm, static_cast<int>(i) };
+    buckets[Key::GetKeyIndex(tracks[i].key)].push_back(e);
+  }
+  for (auto& b : buckets) {
+    std::sort(b.begin(), b.end(), [](Entry const& a, Entry const& b)
+    {
+      return a.semitones < b.semitones;
+    });
+  }
+}
+
+void NeighborIndex::Update(Tracks const& tracks)
+{
+  if (buckets.empty()) {
+    Build(tracks);
+    return;
+  }
+
+  // Take out whatever has gone or changed while we still have the old tempos
+  // and keys to find it by, then put back the new versions
+  std::vector<int> changed;
+  for (size_t i = 0; i < this->tracks.size(); ++i) {
+    if (i >= tracks.size() || this->tracks[i].log_bpm != tracks[i].log_bpm || !(this->tracks[i].key == tracks[i].key)) {
+      Unindex(static_cast<int>(i));
+      if (i < tracks.size()) {
+        changed.push_back(static_cast<int>(i));
+      }
+    }
+  }
+  for (size_t i = this->tracks.size(); i < tracks.size(); ++i) {
+    changed.push_back(static_cast<int>(i));
+  }
+
+  this->tracks = tracks;
+  for (auto idx : changed) {
+    Index(idx);
+  }
+}
+
+void NeighborIndex::Index(int idx)
+{
+  Bucket& bucket = buckets[Key::GetKeyIndex(tracks[idx].key)];
+  Entry e = { tracks[idx].log_bpm, idx };
+  bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), e, [](Entry const& a, Entry const& b)
+  {
+    return a.semitones < b.semitones;
+  }), e);
+}
+
+void NeighborIndex::Unindex(int idx)
+{
+  Bucket& bucket = buckets[Key::GetKeyIndex(tracks[idx].key)];
+  Entry e = { tracks[idx].log_bpm, idx };
+  auto it = std::lower_bound(bucket.begin(), bucket.end(), e, [](Entry const& a, Entry const& b)
+  {
+    return a.semitones < b.semitones;
+  });
+  for (; it != bucket.end(); ++it) {
+    if (it->track == idx) {
+      bucket.erase(it);
+      return;
+    }
+  }
+}
+
+void NeighborIndex::Query(
+  int playing,
+  Key const& play_key,
+  std::vector<bool> const& played,
+  size_t count,
+  Suggestions& suggestions,
+  double max_cost
+  ) const
+{
+  suggestions.clear();
+  if (playing < 0 || playing >= static_cast<int>(tracks.size())) {
+    return;
+  }
+
+  // One walk in each direction through each bucket
+  struct Walk
+  {
+    double cost;
+    int    bucket;
+    int    pos;
+    int    step;
+
+    bool operator>(Walk const& w) const
+    {
+      return cost > w.cost;
+    }
+  };
+
+  double from = tracks[playing].log_bpm;
+  Transition const* transitions = TransitionTable::GetRow(play_key);
+
+  std::vector<Walk> storage;
+  storage.reserve(2 * buckets.size());
+  std::priority_queue<Walk, std::vector<Walk>, std::greater<Walk> > walks(std::greater<Walk>(), storage);
+
+  for (size_t b = 0; b < buckets.size(); ++b) {
+    Bucket const& bucket = buckets[b];
+    if (bucket.empty()) {
+      continue;
+    }
+
+    // Cheapest where the tempo change matches the transposition
+    Entry target = { from - transitions[b].transpose, 0 };
+    int pos = static_cast<int>(std::lower_bound(bucket.begin(), bucket.end(), target, [](Entry const& a, Entry const& b)
+    {
+      return a.semitones < b.semitones;
+    }) - bucket.begin());
+
+    if (pos < static_cast<int>(bucket.size())) {
+      Walk up = { MixAnt::FindTransitionCost(from - bucket[pos].semitones, transitions[b].transpose), static_cast<int>(b), pos, 1 };
+      walks.push(up);
+    }
+    if (pos > 0) {
+      Walk down = { MixAnt::FindTransitionCost(from - bucket[pos-1].semitones, transitions[b].transpose), static_cast<int>(b), pos - 1, -1 };
+      walks.push(down);
+    }
+  }
+
+  while (!walks.empty() && suggestions.size() < count) {
+    Walk w = walks.top();
+    walks.pop();
+    if (w.cost >= max_cost) {
+      break;
+    }
+
+    Bucket const& bucket = buckets[w.bucket];
+    int t = bucket[w.pos].track;
+    if (t != playing && !(t < static_cast<int>(played.size()) && played[t])) {
+      Transition const& next = transitions[w.bucket];
+      Suggestion s = { t, Key::GetKeys()[next.play_key], next.tuning, w.cost };
+      suggestions.push_back(s);
+    }
+
+    w.pos += w.step;
+    if (w.pos >= 0 && w.pos < static_cast<int>(bucket.size())) {
+      w.cost = MixAnt::FindTransitionCost(from - bucket[w.pos].semitones, transitions[w.bucket].transpose);
+      walks.push(w);
+    }
+  }
+}
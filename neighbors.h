@@ -0,0 +1,69 @@
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include <cfloat>
+#include <vector>
+
+#include "key.h"
+#include "track.h"
+
+struct Suggestion
+{
+  int    track;
+  Key    play_key;
+  int    tuning;
+  double cost;
+};
+
+typedef std::vector<Suggestion> Suggestions;
+
+// Answers "what could I play next?" without scanning the whole library
+// Tracks are bucketed by key and sorted by tempo (Track::log_bpm) within each
+// bucket. For a given play key, the transposition into each bucket is fixed
+// (it's in the TransitionTable), and the transition cost is then convex in the
+// tempo difference, with its minimum where the tempo shift matches the transposition
+// So walking outwards from that point gives each bucket's tracks in cost
+// order, and merging those walks through a small heap gives the overall best
+// first, touching only the tracks we return (plus any already played)
+class NeighborIndex
+{
+public:
+
+  void Build(Tracks const& tracks);
+
+  // Brings the index in line with tracks (as Library::Poll leaves them)
+  // Only tracks that were added, removed or changed since the last Build or
+  // Update move between buckets, so a small edit doesn't sort them all again
+  void Update(Tracks const& tracks);
+
+  // Best count tracks to follow playing (played in play_key) by transition
+  // cost, skipping anything marked in played (indexed by track)
+  // Only tracks cheaper than max_cost are returned
+  void Query(
+    int playing,
+    Key const& play_key,
+    std::vector<bool> const& played,
+    size_t count,
+    Suggestions& suggestions,
+    double max_cost = DBL_MAX
+    ) const;
+
+protected:
+
+  struct Entry
+  {
+    double semitones;
+    int    track;
+  };
+
+  typedef std::vector<Entry> Bucket;
+
+  // Adds or takes out tracks[idx] where its tempo puts it in its bucket
+  void Index(int idx);
+  void Unindex(int idx);
+
+  Tracks              tracks;
+  std::vector<Bucket> buckets;
+};
+
+#endif
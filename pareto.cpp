@@ -0,0 +1,69 @@
+#include <algorithm>
+
+#include "pareto.h"
+
+// a is at least as good as b on everything (so equal mixes never pile up)
+static bool Covers(size_t len_a, double total_a, double worst_a, size_t len_b, double total_b, double worst_b)
+{
+  return len_a >= len_b && total_a <= total_b && worst_a <= worst_b;
+}
+
+bool ParetoArchive::Accepts(size_t length, double total, double worst) const
+{
+  for (auto const& e : entries) {
+    if (Covers(e.length, e.total, e.worst, length, total, worst)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParetoArchive::Offer(size_t length, double total, double worst, CompactMix const& mix)
+{
+  if (!Accepts(length, total, worst)) {
+    return false;
+  }
+
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [&](ParetoEntry const& e)
+  {
+    return Covers(length, total, worst, e.length, e.total, e.worst);
+  }), entries.end());
+
+  ParetoEntry entry;
+  entry.length = length;
+  entry.total = total;
+  entry.worst = worst;
+  entry.mix = mix;
+  entries.push_back(entry);
+  return true;
+}
+
+void ParetoArchive::Merge(ParetoArchive const& archive)
+{
+  for (auto const& e : archive.entries) {
+    Offer(e.length, e.total, e.worst, e.mix);
+  }
+}
+
+void ParetoArchive::Clear()
+{
+  entries.clear();
+}
+
+ParetoEntries ParetoArchive::GetFront() const
+{
+  ParetoEntries front(entries);
+  std::sort(front.begin(), front.end(), [](ParetoEntry const& a, ParetoEntry const& b)
+  {
+    if (a.length != b.length) {
+      return a.length > b.length;
+    }
+    return a.total < b.total || (a.total == b.total && a.worst < b.worst);
+  });
+  return front;
+}
+
+size_t ParetoArchive::size() const
+{
+  return entries.size();
+}
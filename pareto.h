@@ -0,0 +1,46 @@
+#ifndef PARETO_H
+#define PARETO_H
+
+#include <vector>
+
+#include "compact.h"
+
+struct ParetoEntry
+{
+  size_t     length;
+  double     total;
+  double     worst;
+  CompactMix mix;
+};
+
+typedef std::vector<ParetoEntry> ParetoEntries;
+
+// Every mix a solver comes across that no other beats on all of length
+// (longer is better), total cost and worst transition at once
+// Mixes are only packed down once they're known to make the front, so
+// offering one that doesn't is just a few comparisons per entry
+// Not thread safe: solvers running at once each keep their own and Merge
+class ParetoArchive
+{
+public:
+
+  // Would a mix with these objectives make the front?
+  bool Accepts(size_t length, double total, double worst) const;
+
+  // Adds the mix if it makes the front, dropping whatever it beats
+  bool Offer(size_t length, double total, double worst, CompactMix const& mix);
+
+  void Merge(ParetoArchive const& archive);
+  void Clear();
+
+  // Longest first, then cheapest
+  ParetoEntries GetFront() const;
+
+  size_t size() const;
+
+protected:
+
+  ParetoEntries entries;
+};
+
+#endif
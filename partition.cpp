@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include <numeric>
+#include <thread>
+
+#include "logger.h"
+#include "metrics.h"
+#include "partition.h"
+
+MixPartitioner::MixPartitioner() :
+  tracks(nullptr),
+  graph(nullptr),
+  trace(nullptr)
+{
+}
+
+void MixPartitioner::SetTrace(ConvergenceTrace* trace)
+{
+  this->trace = trace;
+}
+
+std::vector<Mix> MixPartitioner::Partition(
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  size_t parts,
+  size_t threads
+  )
+{
+  METRIC_TIME(kTimeSearch);
+
+  this->tracks = &tracks;
+  this->graph = &graph;
+  parts = std::min(parts, tracks.size());
+
+  std::vector<std::atomic<int> >(tracks.size()).swap(owners);
+  for (auto& o : owners) {
+    o = -1;
+  }
+
+  // Start each mix in the middle of its own share of the tempo range, so
+  // they mostly grow apart (from the nearest track that leads anywhere)
+  std::vector<int> by_tempo(tracks.size());
+  std::iota(by_tempo.begin(), by_tempo.end(), 0);
+  std::sort(by_tempo.begin(), by_tempo.end(), [&](int a, int b)
+  {
+    return tracks[a].log_bpm < tracks[b].log_bpm;
+  });
+  chains.assign(parts, Chain());
+  for (size_t p = 0; p < parts; ++p) {
+    size_t beg = p * tracks.size() / parts;
+    size_t end = (p + 1) * tracks.size() / parts;
+    size_t mid = (beg + end) / 2;
+    int t = by_tempo[mid];
+    for (size_t step = 1; graph.GetDegree(graph.GetStartNode(t)) == 0 && step <= end - beg; ++step) {
+      size_t pos = step % 2 ? mid + (step + 1) / 2 : mid - step / 2;
+      if (pos >= beg && pos < end && graph.GetDegree(graph.GetStartNode(by_tempo[pos])) > 0) {
+        t = by_tempo[pos];
+      }
+    }
+    owners[t] = static_cast<int>(p);
+    chains[p].push_back(graph.GetStartNode(t));
+  }
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max<size_t>(std::min(threads, parts), 1);
+
+  // Each thread takes every threads-th mix, and grows them a track at a time
+  std::vector<std::vector<size_t> > mine(threads);
+  for (size_t p = 0; p < parts; ++p) {
+    mine[p % threads].push_back(p);
+  }
+  std::vector<unsigned long long> scanned(threads);
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) {
+    workers.push_back(std::thread(&MixPartitioner::Grow, this, std::cref(mine[t]), std::ref(scanned[t])));
+  }
+  Grow(mine[0], scanned[0]);
+  for (auto& w : workers) {
+    w.join();
+  }
+  if (trace) {
+    trace->Count(std::accumulate(scanned.begin(), scanned.end(), 0ULL));
+  }
+  Record();
+
+  while (InsertLeftovers()) {
+    Record();
+  }
+  Balance();
+  Record();
+
+  std::vector<Mix> mixes;
+  size_t used = 0;
+  for (auto const& c : chains) {
+    mixes.push_back(Materialize(c));
+    used += c.size();
+  }
+  LOG(kLogInfo) << "Partitioned " << tracks.size() << " tracks into " << parts << " mixes, leaving " << tracks.size() - used << " unused";
+  return mixes;
+}
+
+void MixPartitioner::Grow(std::vector<size_t> const& mine, unsigned long long& scanned)
+{
+  std::vector<bool> stuck(mine.size(), false);
+  size_t growing = mine.size();
+  while (growing > 0) {
+    for (size_t m = 0; m < mine.size(); ++m) {
+      if (stuck[m]) {
+        continue;
+      }
+
+      // Edges are cheapest first, so the first track we can claim is the
+      // cheapest one left
+      Chain& chain = chains[mine[m]];
+      int tail = chain.back();
+      bool grown = false;
+      METRIC_COUNT(kCandidatesScanned, graph->GetDegree(tail));
+      scanned += graph->GetDegree(tail);
+      for (auto e = graph->EdgesBegin(tail); e != graph->EdgesEnd(tail) && !grown; ++e) {
+        int t = graph->GetTrack(e->node);
+        int none = -1;
+        if (owners[t].load(std::memory_order_relaxed) == -1 && owners[t].compare_exchange_strong(none, static_cast<int>(mine[m]))) {
+          chain.push_back(e->node);
+          grown = true;
+        }
+      }
+
+      if (!grown) {
+        stuck[m] = true;
+        --growing;
+      }
+    }
+  }
+}
+
+bool MixPartitioner::InsertLeftovers()
+{
+  struct Slot
+  {
+    int chain;
+    int pos;
+    int node;
+  };
+
+  // Every place a leftover track could follow, from the edges out of every
+  // node in every mix
+  std::vector<std::vector<Slot> > slots(tracks->size());
+  for (size_t c = 0; c < chains.size(); ++c) {
+    for (size_t pos = 0; pos < chains[c].size(); ++pos) {
+      int node = chains[c][pos];
+      for (auto e = graph->EdgesBegin(node); e != graph->EdgesEnd(node); ++e) {
+        int t = graph->GetTrack(e->node);
+        if (owners[t] < 0) {
+          Slot s = { static_cast<int>(c), static_cast<int>(pos), node };
+          slots[t].push_back(s);
+        }
+      }
+    }
+  }
+
+  // Slots in a mix we've already added to may have moved, so those wait for
+  // the next round
+  bool inserted = false;
+  Chain nodes;
+  Chain best_nodes;
+  for (int t = 0; t < static_cast<int>(tracks->size()); ++t) {
+    if (owners[t] >= 0) {
+      continue;
+    }
+
+    double best_added = DBL_MAX;
+    int best_chain = -1;
+    int best_pos = 0;
+    size_t best_rejoin = 0;
+    auto consider = [&](int c, int pos)
+    {
+      if (trace) {
+        trace->Count(1);
+      }
+      size_t rejoin;
+      double added;
+      if (Reroute(chains[c], pos, t, nodes, rejoin, added) && added < best_added) {
+        best_added = added;
+        best_chain = c;
+        best_pos = pos;
+        best_rejoin = rejoin;
+        best_nodes.swap(nodes);
+      }
+    };
+
+    for (auto const& s : slots[t]) {
+      Chain const& chain = chains[s.chain];
+      if (static_cast<size_t>(s.pos) < chain.size() && chain[s.pos] == s.node) {
+        consider(s.chain, s.pos);
+      }
+    }
+    for (size_t c = 0; c < chains.size(); ++c) {
+      consider(static_cast<int>(c), -1);
+    }
+
+    if (best_chain >= 0) {
+      Chain& chain = chains[best_chain];
+      chain.erase(chain.begin() + (best_pos + 1), chain.begin() + best_rejoin);
+      chain.insert(chain.begin() + (best_pos + 1), best_nodes.begin(), best_nodes.end());
+      owners[t] = best_chain;
+      inserted = true;
+    }
+  }
+  return inserted;
+}
+
+bool MixPartitioner::Reroute(
+  Chain const& chain,
+  int pos,
+  int track,
+  Chain& nodes,
+  size_t& rejoin,
+  double& added
+  ) const
+{
+  nodes.clear();
+  added = 0;
+
+  int prev;
+  if (pos < 0) {
+    prev = graph->GetStartNode(track);
+  } else {
+    GraphEdge const* e = FindEdge(chain[pos], track);
+    if (!e) {
+      return false;
+    }
+    added += e->cost;
+    prev = e->node;
+  }
+  nodes.push_back(prev);
+
+  // The rest of the mix plays on from the new track until it's back in the
+  // keys it was in before
+  for (rejoin = pos + 1; rejoin < chain.size(); ++rejoin) {
+    int next = chain[rejoin];
+    GraphEdge const* e = FindEdge(prev, graph->GetTrack(next));
+    if (!e) {
+      return false;
+    }
+    added += e->cost;
+    if (rejoin > 0) {
+      added -= FindEdge(chain[rejoin-1], graph->GetTrack(next))->cost;
+    }
+    if (e->node == next) {
+      break;
+    }
+    nodes.push_back(e->node);
+    prev = e->node;
+  }
+  return true;
+}
+
+void MixPartitioner::Balance()
+{
+  // Move tracks off the end of one mix onto either end of a shorter one,
+  // where they fit and it evens them up, lengths furthest apart (then
+  // cheapest) first
+  // Every move brings the lengths closer together, so this always finishes
+  Chain nodes;
+  Chain best_nodes;
+  for (;;) {
+    int from = -1;
+    int to = -1;
+    bool to_head = false;
+    size_t best_gap = 0;
+    double best_added = DBL_MAX;
+    size_t best_rejoin = 0;
+    for (size_t d = 0; d < chains.size(); ++d) {
+      int t = graph->GetTrack(chains[d].back());
+      for (size_t r = 0; r < chains.size(); ++r) {
+        if (chains[r].size() + 2 > chains[d].size()) {
+          continue;
+        }
+        size_t gap = chains[d].size() - chains[r].size();
+        if (gap < best_gap) {
+          continue;
+        }
+        auto better = [&](double added)
+        {
+          return gap > best_gap || added < best_added;
+        };
+
+        GraphEdge const* e = FindEdge(chains[r].back(), t);
+        if (e && better(e->cost)) {
+          best_gap = gap;
+          best_added = e->cost;
+          from = static_cast<int>(d);
+          to = static_cast<int>(r);
+          to_head = false;
+          best_nodes.assign(1, e->node);
+        }
+
+        size_t rejoin;
+        double added;
+        if (Reroute(chains[r], -1, t, nodes, rejoin, added) && better(added)) {
+          best_gap = gap;
+          best_added = added;
+          from = static_cast<int>(d);
+          to = static_cast<int>(r);
+          to_head = true;
+          best_rejoin = rejoin;
+          best_nodes.swap(nodes);
+        }
+      }
+    }
+    if (from < 0) {
+      break;
+    }
+
+    Chain& chain = chains[to];
+    owners[graph->GetTrack(chains[from].back())] = to;
+    chains[from].pop_back();
+    if (to_head) {
+      chain.erase(chain.begin(), chain.begin() + best_rejoin);
+      chain.insert(chain.begin(), best_nodes.begin(), best_nodes.end());
+    } else {
+      chain.push_back(best_nodes.front());
+    }
+  }
+}
+
+// Tracks placed so far, and the total cost of every mix
+void MixPartitioner::Record() const
+{
+  if (!trace) {
+    return;
+  }
+  size_t placed = 0;
+  double cost = 0;
+  for (auto const& chain : chains) {
+    placed += chain.size();
+    for (size_t i = 1; i < chain.size(); ++i) {
+      cost += FindEdge(chain[i-1], graph->GetTrack(chain[i]))->cost;
+    }
+  }
+  trace->Record(placed, cost);
+}
+
+GraphEdge const* MixPartitioner::FindEdge(int node, int track) const
+{
+  // A node has at most one edge to each track
+  for (auto e = graph->EdgesBegin(node); e != graph->EdgesEnd(node); ++e) {
+    if (graph->GetTrack(e->node) == track) {
+      return e;
+    }
+  }
+  return nullptr;
+}
+
+Mix MixPartitioner::Materialize(Chain const& chain) const
+{
+  Mix m;
+  for (auto node : chain) {
+    MixStep step((*tracks)[graph->GetTrack(node)]);
+    step.SetPlayKey(graph->GetKey(node));
+    if (!m.steps.empty()) {
+      m.steps.back().bpm_end = step.bpm_beg;
+    }
+    m.steps.push_back(step);
+  }
+  m.CalculateDistance();
+  return m;
+}
@@ -0,0 +1,78 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <atomic>
+#include <vector>
+
+#include "graph.h"
+#include "mix.h"
+#include "trace.h"
+#include "track.h"
+
+// Splits tracks into several mixes that share no tracks (one per DJ or per
+// room, say), all in one pass
+// Each mix starts from its own stretch of the tempo range and grows on its
+// own thread, taking the cheapest next track it can claim: a track belongs to
+// whichever mix claims it first, so mixes only contend through one atomic
+// compare and swap per track
+// Once no mix can grow, leftover tracks are slotted in wherever they cost
+// least (anywhere a mix can still play through them), and then the longest
+// mixes hand tracks off their ends to the shortest where they fit
+// Which mix wins a contended track depends on the threads, so only a single
+// thread partitions the same way every time
+class MixPartitioner
+{
+public:
+
+  MixPartitioner();
+
+  // Records the tracks placed (and what all the mixes cost) after each phase
+  void SetTrace(ConvergenceTrace* trace);
+
+  // graph is a kRuleDistance graph for tracks
+  // Zero threads means one per hardware thread
+  std::vector<Mix> Partition(
+    Tracks const& tracks,
+    CompatibilityGraph const& graph,
+    size_t parts,
+    size_t threads = 0
+    );
+
+protected:
+
+  // A mix as the graph nodes it plays
+  typedef std::vector<int> Chain;
+
+  void Grow(std::vector<size_t> const& chains, unsigned long long& scanned);
+  bool InsertLeftovers();
+  void Balance();
+  void Record() const;
+
+  // Nodes replacing chain[pos+1, rejoin) if track plays after chain[pos]
+  // (pos -1 puts it first): the track's own node, then any that follow in a
+  // different key until the chain falls back in line
+  // False if some transition isn't in the graph
+  bool Reroute(
+    Chain const& chain,
+    int pos,
+    int track,
+    Chain& nodes,
+    size_t& rejoin,
+    double& added
+    ) const;
+
+  GraphEdge const* FindEdge(int node, int track) const;
+
+  Mix Materialize(Chain const& chain) const;
+
+  Tracks const*             tracks;
+  CompatibilityGraph const* graph;
+  ConvergenceTrace*         trace;
+  std::vector<Chain>        chains;
+
+  // Mix each track belongs to (-1 for none), claimed with a compare and swap
+  // while growing
+  std::vector<std::atomic<int> > owners;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "pool.h"
+
+ThreadPool::ThreadPool(size_t threads) : stop(false)
+{
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers.push_back(std::thread(&ThreadPool::Run, this));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stop = true;
+  }
+  queue_ready.notify_all();
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+std::future<std::string> ThreadPool::Submit(std::function<std::string()> job)
+{
+  auto task = std::make_shared<Job>(job);
+  std::future<std::string> result = task->get_future();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.push_back(task);
+  }
+  queue_ready.notify_one();
+  return result;
+}
+
+size_t ThreadPool::GetSize() const
+{
+  return workers.size();
+}
+
+void ThreadPool::Run()
+{
+  for (;;) {
+    std::shared_ptr<Job> task;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_ready.wait(lock, [this] { return stop || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+      task = queue.front();
+      queue.pop_front();
+    }
+    (*task)();
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads taking jobs off a shared queue
+class ThreadPool
+{
+public:
+
+  // Zero threads means one per hardware thread
+  ThreadPool(size_t threads = 0);
+
+  // Finishes any queued jobs first
+  ~ThreadPool();
+
+  std::future<std::string> Submit(std::function<std::string()> job);
+
+  size_t GetSize() const;
+
+protected:
+
+  void Run();
+
+  typedef std::packaged_task<std::string()> Job;
+
+  std::mutex                         queue_mutex;
+  std::condition_variable            queue_ready;
+  std::deque<std::shared_ptr<Job> >  queue;
+  bool                               stop;
+  std::vector<std::thread>           workers;
+};
+
+#endif
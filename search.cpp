@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <set>
+
+#include "costs.h"
+#include "logger.h"
+#include "metrics.h"
+#include "search.h"
+#include "transition.h"
+
+using namespace std;
+
+KeySet GetAvailableKeys(KeyCount const& kc)
+{
+  KeySet available;
+  for (auto k : kc) {
+    if (k.second <= 0) {
+      continue;
+    }
+    available.insert(k.first);
+  }
+  return available;
+}
+
+bool ChooseKey(Key const& key, KeyCount const& key_count, Keys order, int depth, int& max_depth, ConvergenceTrace* trace)
+{
+  // Key orders don't have a cost, only a length
+  if (trace) {
+    trace->Count(1);
+  }
+  if (depth > max_depth) {
+    max_depth = depth;
+    if (trace) {
+      trace->Record(max_depth, 0);
+    }
+    static thread_local double last_progress = 0;
+    if (Logger::Due(last_progress, kProgressInterval)) {
+      LOG(kLogInfo) << "New max depth: " << max_depth;
+    }
+  }
+
+  // We've run out of tracks!
+  // We've found a potential solution!
+  if (GetAvailableKeys(key_count).empty()) {
+    return true;
+  }
+
+  // Add it to our order, but it's no longer available
+  order.push_back(key);
+
+  // Make our own copy to iterate through...
+  // Subtract an instance of the key we just used
+  KeyCount new_counts(key_count);
+  if (--new_counts[key] == 0) {
+    new_counts.erase(key);
+  }
+  
+  // Find all compatible tracks, then try to choose each one in turn
+  bool found_compatible = false;
+  Keys compatible;
+  Key::GetCompatibleKeys(key, compatible);
+  for (auto k : compatible) {
+    if (new_counts.find(k) != new_counts.end()) {
+      ChooseKey(k, new_counts, order, depth + 1, max_depth, trace);
+      found_compatible = true;
+    }
+  }
+
+  // Dead end solution...
+  return found_compatible;
+}
+
+// ASSUME:
+// t1 cannot be changed (bpm, key)
+// t2 can be changed (only deal with key right now)
+// We'll transpose within the key threshold
+// We assume tempo we can change kind of however we want within BPM thresholds
+// Keys we need to follow so that we don't shift down a bunch and then try to match
+// with something high in the next track
+bool AreCompatibleTracks(
+  Track const& t1, 
+  Track const& t2,
+  double bpm_thr,
+  int key_thr,
+  Key& t2_adj,
+  double& cost
+  )
+{
+  auto min_bpm = min(t1.bpm, t2.bpm);
+  auto max_bpm = max(t1.bpm, t2.bpm);
+  auto bpm_rat = abs(max_bpm / min_bpm);
+  bool compatible_bpm = bpm_rat < (1 + bpm_thr);
+
+  if (!compatible_bpm) {
+    return false;
+  }
+
+  // Smallest shift of t2's key that makes it compatible with t1
+  Transition const& t = TransitionTable::Get(t1.key, t2.key);
+  if (abs(t.shift) > key_thr) {
+    return false;
+  }
+  t2_adj = Key::GetKeys()[t.shift_key];
+
+  cost = KeyShiftCost::Edge(t1, t2, t);
+
+  return true;
+}
+
+template <typename Aggregate>
+static void Choose(
+  vector<string> const& names,
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  vector<bool>& used,
+  CompactMix& chosen,
+  int prev_node,
+  double cost,
+  double& best_cost,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  int& its,
+  ConvergenceTrace* trace,
+  ParetoArchive* front,
+  double total,
+  double worst
+  )
+{
+  METRIC_COUNT(kNodesExpanded, 1);
+
+  // We're too long, or already good enough!
+  if (chosen.size() >= static_cast<size_t>(max_len) || best.size() >= stop_len) {
+    METRIC_COUNT(kNodesPruned, 1);
+    return;
+  }
+
+  if (front) {
+    front->Offer(chosen.size(), total, worst, chosen);
+  }
+
+  // We have a new best length (more important than cost)
+  if (chosen.size() > best.size()) {
+    best_cost = cost;
+    best = chosen;
+    LOG(kLogInfo) << "New best of length " << best.size() << " found.";
+    METRIC_IMPROVEMENT(best.size(), best_cost);
+    if (trace) {
+      trace->Record(best.size(), best_cost);
+    }
+    its = 0;
+  } 
+  // Mix length is the same, but less cost
+  else if (chosen.size() == best.size() && cost < best_cost && !chosen.empty()) {
+    best_cost = cost;
+    LOG(kLogDebug) << "New best cost of " << best_cost << " found.";
+    METRIC_IMPROVEMENT(best.size(), best_cost);
+    if (trace) {
+      trace->Record(best.size(), best_cost);
+    }
+    best = chosen;
+    its = 0;
+  }
+  // No improvement!
+  else {
+    ++its;
+  }
+
+  // We've spent too long, so bail!
+  if (its >= 1000000) {
+    LOG(kLogDebug) << "Too many iterations without improvement!";
+    METRIC_COUNT(kNodesPruned, 1);
+    return;
+  }
+
+  // Nothing to look at
+  if (chosen.size() >= tracks.size()) {
+    LOG(kLogDebug) << "No more tracks to choose.";
+    return;
+  }
+
+  METRIC_COUNT(kCandidatesScanned, graph.GetDegree(prev_node));
+  if (trace) {
+    trace->Count(graph.GetDegree(prev_node));
+  }
+
+  // Every compatible track (with its adjusted key) is an edge in the graph
+  for (auto e = graph.EdgesBegin(prev_node); e != graph.EdgesEnd(prev_node); ++e) {
+    int idx = graph.GetTrack(e->node);
+    if (used[idx]) {
+      continue;
+    }
+    METRIC_COUNT(kCandidatesUsable, 1);
+    Track const& t = tracks[idx];
+
+    // Extend the chosen mix in place, and take it back off once we're done
+    // NOTE: The node carries an ADJUSTED key for this track!
+    used[idx] = true;
+    chosen.Push(t.idx, graph.GetKey(e->node), t.bpm, t.bpm);
+
+    Choose<Aggregate>(names, tracks, graph, used, chosen, e->node, Aggregate::Add(cost, e->cost), best_cost, max_len, stop_len, best, its, trace, front, total + e->cost, std::max(worst, e->cost));
+
+    chosen.Pop();
+    used[idx] = false;
+  }
+}
+
+void ChooseTrack(
+  vector<string> const& names,
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  vector<bool>& used,
+  CompactMix& chosen,
+  int prev_node,
+  double cost,
+  double& best_cost,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  int& its,
+  ConvergenceTrace* trace,
+  CostAggregate aggregate,
+  ParetoArchive* front
+  )
+{
+  typedef void (*Chooser)(
+    vector<string> const&,
+    Tracks const&,
+    CompatibilityGraph const&,
+    vector<bool>&,
+    CompactMix&,
+    int,
+    double,
+    double&,
+    int,
+    size_t,
+    CompactMix&,
+    int&,
+    ConvergenceTrace*,
+    ParetoArchive*,
+    double,
+    double
+    );
+
+  // Indexed by CostAggregate
+  static Chooser const kChoosers[] = {
+    &Choose<SumCost>,
+    &Choose<MaxCost>
+  };
+
+  kChoosers[aggregate](names, tracks, graph, used, chosen, prev_node, cost, best_cost, max_len, stop_len, best, its, trace, front, cost, cost);
+}
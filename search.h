@@ -0,0 +1,65 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "compact.h"
+#include "costs.h"
+#include "graph.h"
+#include "library.h"
+#include "pareto.h"
+#include "trace.h"
+#include "track.h"
+
+typedef std::set<Key> KeySet;
+
+KeySet GetAvailableKeys(KeyCount const& kc);
+
+// Each new max depth is recorded in trace, if there is one
+bool ChooseKey(
+  Key const& key,
+  KeyCount const& key_count,
+  Keys order,
+  int depth,
+  int& max_depth,
+  ConvergenceTrace* trace = nullptr
+  );
+
+bool AreCompatibleTracks(
+  Track const& t1,
+  Track const& t2,
+  double bpm_thr,
+  int key_thr,
+  Key& t2_adj,
+  double& cost
+  );
+
+// Exhaustive search for the longest (then cheapest) mix starting from
+// prev_node, a node of a kRuleKeyShift graph built for tracks
+// Tracks marked in used are skipped (and are left as they were on return)
+// Stops as soon as the best mix reaches stop_len tracks
+// Improvements are recorded in trace, if there is one
+// Mix costs add up edge costs as the aggregate says
+// Every mix visited is offered to front, if there is one, by its total and
+// worst edge costs (counting cost as both so far)
+void ChooseTrack(
+  std::vector<std::string> const& names,
+  Tracks const& tracks,
+  CompatibilityGraph const& graph,
+  std::vector<bool>& used,
+  CompactMix& chosen,
+  int prev_node,
+  double cost,
+  double& best_cost,
+  int max_len,
+  size_t stop_len,
+  CompactMix& best,
+  int& its,
+  ConvergenceTrace* trace = nullptr,
+  CostAggregate aggregate = kAggregateSum,
+  ParetoArchive* front = nullptr
+  );
+
+#endif
@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "horizon.h"
+#include "logger.h"
+#include "metrics.h"
+#include "server.h"
+
+// How often the accept loop checks whether it's been asked to stop (ms)
+static const int kAcceptPollMs = 200;
+
+// How often (in seconds) the metrics snapshot is rewritten while serving
+static const double kMetricsInterval = 10.0;
+static char const* const kMetricsPath = "metrics.json";
+
+// Suggestions returned when a request doesn't ask for a number
+static const size_t kDefaultSuggestions = 10;
+
+static std::vector<std::string> Split(std::string const& line)
+{
+  std::vector<std::string> tokens;
+  std::stringstream ss(line);
+  std::string token;
+  while (ss >> token) {
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+static std::vector<int> ParseIndices(std::string const& list)
+{
+  std::vector<int> indices;
+  std::stringstream ss(list);
+  std::string token;
+  while (getline(ss, token, ',')) {
+    indices.push_back(atoi(token.c_str()));
+  }
+  return indices;
+}
+
+// Looks for a key=value argument
+static std::string GetOption(
+  std::vector<std::string> const& args,
+  std::string const& key,
+  std::string const& fallback
+  )
+{
+  for (auto const& a : args) {
+    if (a.size() > key.size() && !a.compare(0, key.size(), key) && a[key.size()] == '=') {
+      return a.substr(key.size() + 1);
+    }
+  }
+  return fallback;
+}
+
+static std::string JsonEscape(std::string const& str)
+{
+  std::string escaped;
+  for (auto c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += ' ';
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+static std::string Error(std::string const& message)
+{
+  return "{\"ok\": false, \"error\": \"" + JsonEscape(message) + "\"}";
+}
+
+static std::string KeyName(Key const& k)
+{
+  return Key::GetShortName(k.num, k.type);
+}
+
+static std::string MixToJson(
+  Mix const& m,
+  std::vector<std::string> const& names,
+  double seconds,
+  ParetoArchive const* front = nullptr,
+  DiverseMixes const* alternatives = nullptr
+  )
+{
+  std::stringstream ss;
+  ss << "{\"ok\": true, \"length\": " << m.steps.size()
+     << ", \"cost\": " << m.GetTotalCost()
+     << ", \"max_cost\": " << m.GetMaxCost()
+     << ", \"seconds\": " << seconds
+     << ", \"steps\": [";
+  for (size_t i = 0; i < m.steps.size(); ++i) {
+    MixStep const& s = m.steps[i];
+    ss << (i ? ", " : "")
+       << "{\"track\": " << s.track.idx
+       << ", \"name\": \"" << JsonEscape(names[s.track.idx]) << "\""
+       << ", \"key\": \"" << KeyName(s.GetPlayKey()) << "\""
+       << ", \"bpm_beg\": " << s.bpm_beg
+       << ", \"bpm_end\": " << s.bpm_end
+       << ", \"cost\": " << m.GetEdgeCosts()[i] << "}";
+  }
+  ss << "]";
+  if (front) {
+    ss << ", \"front\": [";
+    ParetoEntries entries = front->GetFront();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      ParetoEntry const& e = entries[i];
+      ss << (i ? ", " : "")
+         << "{\"length\": " << e.length
+         << ", \"cost\": " << e.total
+         << ", \"max_cost\": " << e.worst
+         << ", \"tracks\": [";
+      for (size_t j = 0; j < e.mix.order.size(); ++j) {
+        ss << (j ? ", " : "") << e.mix.order[j];
+      }
+      ss << "]}";
+    }
+    ss << "]";
+  }
+  if (alternatives) {
+    ss << ", \"alternatives\": [";
+    std::vector<CompactMix> mixes = alternatives->GetMixes();
+    for (size_t i = 0; i < mixes.size(); ++i) {
+      ss << (i ? ", " : "")
+         << "{\"length\": " << mixes[i].size()
+         << ", \"cost\": " << mixes[i].cost
+         << ", \"tracks\": [";
+      for (size_t j = 0; j < mixes[i].order.size(); ++j) {
+        ss << (j ? ", " : "") << mixes[i].order[j];
+      }
+      ss << "]}";
+    }
+    ss << "]";
+  }
+  ss << "}";
+  return ss.str();
+}
+
+static double Now()
+{
+  using namespace std::chrono;
+  return duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+MixServer::MixServer(size_t threads) : pool(threads), stop(false)
+{
+}
+
+MixServer::EnginePtr MixServer::GetEngine(std::string const& path, bool reload)
+{
+  {
+    std::lock_guard<std::mutex> lock(engines_mutex);
+    auto it = engines.find(path);
+    if (it != engines.end() && !reload) {
+      return it->second;
+    }
+  }
+
+  // Load outside the lock so other libraries stay available meanwhile
+  // (two requests racing to load the same library just both load it)
+  std::shared_ptr<Engine> engine = std::make_shared<Engine>();
+  engine->Load(path);
+  if (engine->GetLibrary().GetTracks().empty()) {
+    throw "No tracks in library " + path;
+  }
+  LOG(kLogInfo) << "Loaded " << engine->GetLibrary().GetTracks().size() << " tracks from " << path;
+
+  std::lock_guard<std::mutex> lock(engines_mutex);
+  engines[path] = engine;
+  return engine;
+}
+
+std::string MixServer::Handle(std::string const& request)
+{
+  std::vector<std::string> args = Split(request);
+  if (args.empty()) {
+    return Error("Empty request");
+  }
+
+  try {
+    std::string const& command = args[0];
+    if (command == "SHUTDOWN") {
+      Stop();
+      return "{\"ok\": true}";
+    }
+    if (args.size() < 2) {
+      return Error("Missing library");
+    }
+    if (command == "SOLVE") {
+      return Solve(args);
+    } else if (command == "SUGGEST") {
+      return Suggest(args);
+    } else if (command == "SCORE") {
+      return Score(args);
+    } else if (command == "PARTITION") {
+      return Partition(args);
+    } else if (command == "RELOAD") {
+      GetEngine(args[1], true);
+      return "{\"ok\": true}";
+    }
+    return Error("Unknown command " + command);
+  }
+  catch (char const* e) {
+    return Error(e);
+  }
+  catch (std::string const& e) {
+    return Error(e);
+  }
+  catch (std::exception const& e) {
+    return Error(e.what());
+  }
+}
+
+std::string MixServer::Solve(std::vector<std::string> const& args)
+{
+  EnginePtr engine = GetEngine(args[1], false);
+
+  // Solves share the request pool's threads, so groups are solved one by one
+  SolveOptions options;
+  options.threads = 1;
+  std::string solver = GetOption(args, "solver", "ant");
+  options.solver =
+    solver == "exhaustive" ? kSolverExhaustive :
+    solver == "bottleneck" ? kSolverBottleneck :
+    solver == "horizon" ? kSolverHorizon :
+    kSolverAnt;
+  options.runs = atoi(GetOption(args, "runs", std::to_string(kMixRuns)).c_str());
+  options.seed = strtoul(GetOption(args, "seed", std::to_string(options.seed)).c_str(), nullptr, 10);
+  options.budget = atof(GetOption(args, "budget", "0").c_str());
+  options.class_bpm = atof(GetOption(args, "classes", "-1").c_str());
+  options.window = atoi(GetOption(args, "window", std::to_string(kHorizonWindow)).c_str());
+  options.commit = atoi(GetOption(args, "commit", std::to_string(kHorizonCommit)).c_str());
+
+  std::string cost = GetOption(args, "cost", "");
+  if (cost == "transition") {
+    options.cost = kCostTransition;
+  } else if (cost == "shift") {
+    options.cost = kCostKeyShift;
+  } else if (!cost.empty()) {
+    return Error("Unknown cost " + cost);
+  }
+  options.aggregate = GetOption(args, "aggregate", "sum") == "max" ? kAggregateMax : kAggregateSum;
+
+  ParetoArchive front;
+  if (GetOption(args, "front", "0") == "1") {
+    options.front = &front;
+  }
+
+  DiverseMixes alternatives(
+    atoi(GetOption(args, "alternatives", "0").c_str()),
+    atof(GetOption(args, "diversity", std::to_string(kDefaultDiversity)).c_str())
+    );
+  if (alternatives.GetCount() > 0) {
+    options.alternatives = &alternatives;
+  }
+
+  double beg = Now();
+  std::string tracks = GetOption(args, "tracks", "");
+  Mix m = tracks.empty() ? engine->Solve(options) : engine->Solve(ParseIndices(tracks), options);
+  return MixToJson(m, engine->GetLibrary().GetNames(), Now() - beg, options.front, options.alternatives);
+}
+
+std::string MixServer::Suggest(std::vector<std::string> const& args)
+{
+  if (args.size() < 3) {
+    return Error("Missing track");
+  }
+  EnginePtr engine = GetEngine(args[1], false);
+  Library const& library = engine->GetLibrary();
+
+  int from = atoi(args[2].c_str());
+  if (from < 0 || from >= static_cast<int>(library.GetTracks().size())) {
+    return Error("Invalid track index");
+  }
+  size_t count = atoi(GetOption(args, "count", std::to_string(kDefaultSuggestions)).c_str());
+
+  // Play key defaults to the track's own key
+  Track const& prev = library.GetTracks()[from];
+  std::string key_name = GetOption(args, "key", "");
+  Key play_key = key_name.empty() ? prev.key : Key::KeyFromString(key_name);
+
+  std::vector<bool> played(library.GetTracks().size());
+  for (auto idx : ParseIndices(GetOption(args, "played", ""))) {
+    if (idx >= 0 && idx < static_cast<int>(played.size())) {
+      played[idx] = true;
+    }
+  }
+
+  Suggestions suggestions = engine->Suggest(from, play_key, played, count);
+
+  std::stringstream ss;
+  ss << "{\"ok\": true, \"suggestions\": [";
+  for (size_t i = 0; i < suggestions.size(); ++i) {
+    Suggestion const& s = suggestions[i];
+    ss << (i ? ", " : "")
+       << "{\"track\": " << s.track
+       << ", \"name\": \"" << JsonEscape(library.GetNames()[s.track]) << "\""
+       << ", \"key\": \"" << KeyName(s.play_key) << "\""
+       << ", \"tuning\": " << s.tuning
+       << ", \"cost\": " << s.cost << "}";
+  }
+  ss << "]}";
+  return ss.str();
+}
+
+std::string MixServer::Score(std::vector<std::string> const& args)
+{
+  if (args.size() < 3) {
+    return Error("Missing tracks");
+  }
+  EnginePtr engine = GetEngine(args[1], false);
+
+  double beg = Now();
+  Mix m = engine->Score(ParseIndices(args[2]));
+  return MixToJson(m, engine->GetLibrary().GetNames(), Now() - beg);
+}
+
+std::string MixServer::Partition(std::vector<std::string> const& args)
+{
+  if (args.size() < 3) {
+    return Error("Missing number of mixes");
+  }
+  EnginePtr engine = GetEngine(args[1], false);
+
+  // Partitions share the request pool's threads, so each grows on one
+  SolveOptions options;
+  options.threads = 1;
+
+  double beg = Now();
+  std::vector<Mix> mixes = engine->Partition(atoi(args[2].c_str()), options);
+
+  size_t used = 0;
+  std::stringstream ss;
+  ss << "{\"ok\": true, \"mixes\": [";
+  for (size_t i = 0; i < mixes.size(); ++i) {
+    Mix const& m = mixes[i];
+    used += m.steps.size();
+    ss << (i ? ", " : "")
+       << "{\"length\": " << m.steps.size()
+       << ", \"cost\": " << m.GetTotalCost()
+       << ", \"max_cost\": " << m.GetMaxCost()
+       << ", \"tracks\": [";
+    for (size_t j = 0; j < m.steps.size(); ++j) {
+      ss << (j ? ", " : "") << m.steps[j].track.idx;
+    }
+    ss << "]}";
+  }
+  ss << "], \"unused\": " << engine->GetLibrary().GetTracks().size() - used
+     << ", \"seconds\": " << Now() - beg << "}";
+  return ss.str();
+}
+
+void MixServer::Stop()
+{
+  stop = true;
+}
+
+#ifdef _WIN32
+
+bool MixServer::Serve(std::string const& socket_path)
+{
+  LOG(kLogError) << "Serving on " << socket_path << " needs Unix domain sockets, which this build doesn't support";
+  return false;
+}
+
+void MixServer::ServeConnection(int fd)
+{
+}
+
+#else
+
+static bool SendAll(int fd, std::string const& data)
+{
+#ifdef MSG_NOSIGNAL
+  int flags = MSG_NOSIGNAL;
+#else
+  int flags = 0;
+#endif
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, flags);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+bool MixServer::Serve(std::string const& socket_path)
+{
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    LOG(kLogError) << "Socket path " << socket_path << " is too long";
+    return false;
+  }
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    LOG(kLogError) << "Couldn't create a socket";
+    return false;
+  }
+  unlink(socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+    LOG(kLogError) << "Couldn't listen on " << socket_path;
+    close(listen_fd);
+    return false;
+  }
+  LOG(kLogInfo) << "Serving on " << socket_path << " with " << pool.GetSize() << " threads";
+
+  stop = false;
+  double last_metrics = Metrics::Elapsed();
+  while (!stop) {
+    if (Metrics::Elapsed() - last_metrics >= kMetricsInterval) {
+      METRIC_WRITE(kMetricsPath);
+      last_metrics = Metrics::Elapsed();
+    }
+
+    pollfd pfd = { listen_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, kAcceptPollMs) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      connections.push_back(fd);
+    }
+    std::thread(&MixServer::ServeConnection, this, fd).detach();
+  }
+
+  close(listen_fd);
+  unlink(socket_path.c_str());
+
+  // Hang up on everyone, and wait for their threads to notice
+  std::unique_lock<std::mutex> lock(connections_mutex);
+  for (auto fd : connections) {
+    shutdown(fd, SHUT_RDWR);
+  }
+  connections_done.wait(lock, [this] { return connections.empty(); });
+  METRIC_WRITE(kMetricsPath);
+  LOG(kLogInfo) << "Stopped serving on " << socket_path;
+  return true;
+}
+
+void MixServer::ServeConnection(int fd)
+{
+  std::string pending;
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    pending.append(buffer, n);
+
+    size_t end;
+    bool open = true;
+    while (open && (end = pending.find('\n')) != std::string::npos) {
+      std::string line = pending.substr(0, end);
+      pending.erase(0, end + 1);
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty()) {
+        continue;
+      }
+      // Pool threads live as long as the server, so they hand over their
+      // metrics after every request
+      std::string reply = pool.Submit([this, line]
+      {
+        std::string reply = Handle(line);
+        METRIC_FLUSH();
+        return reply;
+      }).get();
+      open = SendAll(fd, reply + "\n");
+    }
+    if (!open) {
+      break;
+    }
+  }
+
+  // Forget the descriptor before closing it, so Serve can't shut down a new
+  // connection that's been handed the same number
+  std::lock_guard<std::mutex> lock(connections_mutex);
+  connections.erase(std::find(connections.begin(), connections.end(), fd));
+  close(fd);
+  connections_done.notify_all();
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "pool.h"
+
+// A resident mix server
+// Libraries are loaded (with their distances and indices) the first time a
+// request names them and then kept, so a request only pays for its solve
+//
+// Requests are single lines, and every reply is a single line of JSON:
+//
+//   SOLVE <library> [solver=ant|exhaustive|bottleneck|horizon] [runs=N] [seed=S] [budget=seconds] [tracks=i,j,...] [classes=bpm]
+//         [cost=transition|shift] [aggregate=sum|max] [front=1]
+//         [alternatives=K] [diversity=D] [window=W] [commit=C]
+//   SUGGEST <library> <track> [key=K] [played=i,j,...] [count=N]
+//   SCORE <library> <i,j,...>
+//   PARTITION <library> <mixes>
+//   RELOAD <library>
+//   SHUTDOWN
+//
+// With front=1, a solve also replies with every mix it found that no other
+// beats on length, cost and max_cost at once (as track indices), and with
+// alternatives=K the K best mixes sharing less than 1 - D of their transitions
+// SUGGEST only lists tracks compatible with the one playing, cheapest first
+//
+// Requests run on a shared thread pool, so slow solves from one client don't
+// hold up another, and every solve can be given its own time budget
+// Metrics (see metrics.h) are written to metrics.json every so often while
+// serving, and once more when it stops
+class MixServer
+{
+public:
+
+  // Zero threads means one per hardware thread
+  MixServer(size_t threads = 0);
+
+  // Listens on a Unix domain socket until SHUTDOWN or Stop
+  // Returns false if the socket couldn't be set up
+  bool Serve(std::string const& socket_path);
+  void Stop();
+
+  // Handles a single request line and returns the reply
+  std::string Handle(std::string const& request);
+
+protected:
+
+  typedef std::shared_ptr<Engine const> EnginePtr;
+
+  EnginePtr GetEngine(std::string const& path, bool reload);
+
+  std::string Solve(std::vector<std::string> const& args);
+  std::string Suggest(std::vector<std::string> const& args);
+  std::string Score(std::vector<std::string> const& args);
+  std::string Partition(std::vector<std::string> const& args);
+
+  void ServeConnection(int fd);
+
+  ThreadPool pool;
+
+  // Engines are never changed once loaded, and a reload swaps in a new one,
+  // so requests already running keep the engine they started with
+  std::mutex                       engines_mutex;
+  std::map<std::string, EnginePtr> engines;
+
+  // Each connection gets a (detached) thread to read its requests
+  std::atomic<bool>       stop;
+  std::mutex              connections_mutex;
+  std::condition_variable connections_done;
+  std::vector<int>        connections;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <cmath>
+#include <random>
+#include <sstream>
+
+#include "synth.h"
+
+struct TempoCluster
+{
+  double weight;
+  double bpm;
+  double spread;
+};
+
+static const TempoCluster kTempoClusters[] = {
+  { 0.25,  90, 4 },
+  { 0.35, 128, 3 },
+  { 0.25, 174, 2 }
+};
+
+// Everything left over is spread evenly over this range
+static const double kMinStrayBPM = 70;
+static const double kMaxStrayBPM = 180;
+
+// Most tags are whole numbers
+static const double kWholeBPMChance = 0.7;
+
+void SyntheticCrate::Generate(
+  size_t num_tracks,
+  unsigned int seed,
+  Tracks& tracks,
+  std::vector<std::string>& names
+  )
+{
+  tracks.clear();
+  names.clear();
+  tracks.reserve(num_tracks);
+  names.reserve(num_tracks);
+
+  std::mt19937 eng(seed);
+
+  // Zipf-like popularity over keys, with minor keys a bit more popular
+  Keys const& keys = Key::GetKeys();
+  std::vector<double> key_weights(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    key_weights[i] = (keys[i].type == Key::kMinor ? 1.5 : 1.0) / pow(i + 1.0, 0.8);
+  }
+  std::discrete_distribution<int> rnd_key(key_weights.begin(), key_weights.end());
+
+  std::uniform_real_distribution<double> rnd_unit(0, 1);
+  std::uniform_real_distribution<double> rnd_stray(kMinStrayBPM, kMaxStrayBPM);
+
+  for (size_t i = 0; i < num_tracks; ++i) {
+    double bpm = 0;
+    double pick = rnd_unit(eng);
+    for (auto const& c : kTempoClusters) {
+      if (pick < c.weight) {
+        bpm = std::normal_distribution<double>(c.bpm, c.spread)(eng);
+        break;
+      }
+      pick -= c.weight;
+    }
+    if (bpm <= 0) {
+      bpm = rnd_stray(eng);
+    }
+
+    if (rnd_unit(eng) < kWholeBPMChance) {
+      bpm = floor(bpm + 0.5);
+    } else {
+      bpm = floor(bpm * 10 + 0.5) / 10;
+    }
+
+    std::stringstream name;
+    name << "synthetic " << i;
+
+    tracks.push_back(Track(i, bpm, keys[rnd_key(eng)]));
+    names.push_back(name.str());
+  }
+}
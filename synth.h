@@ -0,0 +1,24 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <string>
+#include <vector>
+
+#include "track.h"
+
+// Generates made-up crates that look like real ones: keys are skewed towards
+// a few favourites, and tempos cluster around hip-hop (90), house (128) and
+// drum & bass (174) with some strays in between
+class SyntheticCrate
+{
+public:
+
+  static void Generate(
+    size_t num_tracks,
+    unsigned int seed,
+    Tracks& tracks,
+    std::vector<std::string>& names
+    );
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+
+#include "tempo.h"
+#include "utils.h"
+
+static double ToSemitones(double bpm)
+{
+  return log(bpm) / log(Utils::GetSemitoneRatio());
+}
+
+static double FromSemitones(double st)
+{
+  return pow(Utils::GetSemitoneRatio(), st);
+}
+
+void TempoPlanner::SolveTridiagonal(
+  size_t n,
+  double const* a,
+  double const* b,
+  double const* c,
+  double* d,
+  double* scratch
+  )
+{
+  if (n == 0) {
+    return;
+  }
+
+  // Forward sweep
+  scratch[0] = c[0] / b[0];
+  d[0] = d[0] / b[0];
+  for (size_t j = 1; j < n; ++j) {
+    double m = 1.0 / (b[j] - a[j] * scratch[j-1]);
+    scratch[j] = c[j] * m;
+    d[j] = (d[j] - a[j] * d[j-1]) * m;
+  }
+
+  // Back substitution
+  for (size_t j = n - 1; j-- > 0;) {
+    d[j] -= scratch[j] * d[j+1];
+  }
+}
+
+// Half the objective's derivative in x[j]
+double TempoPlanner::Gradient(size_t j) const
+{
+  size_t steps = target.size();
+  double g = 0;
+  if (j > 0) {
+    g += x[j] - target[j-1] + kRampWeight * (x[j] - x[j-1]);
+  }
+  if (j < steps) {
+    g += x[j] - target[j] + kRampWeight * (x[j] - x[j+1]);
+  }
+  return g;
+}
+
+// Fixed hand-offs get an identity row so the solver leaves them at their bound
+void TempoPlanner::Build(std::vector<char> const& fixed)
+{
+  size_t steps = target.size();
+  size_t n = steps + 1;
+
+  a.assign(n, 0);
+  b.assign(n, 0);
+  c.assign(n, 0);
+  for (size_t i = 0; i < steps; ++i) {
+    b[i]   += 1 + kRampWeight;
+    b[i+1] += 1 + kRampWeight;
+    c[i]   -= kRampWeight;
+    a[i+1] -= kRampWeight;
+  }
+
+  for (size_t j = 0; j < n; ++j) {
+    if (fixed[j]) {
+      a[j] = 0;
+      b[j] = 1;
+      c[j] = 0;
+      continue;
+    }
+    x[j] = (j > 0 ? target[j-1] : 0) + (j < steps ? target[j] : 0);
+  }
+}
+
+double TempoPlanner::Plan(Mix& mix, std::vector<double> const* stretch)
+{
+  size_t steps = mix.steps.size();
+  if (steps == 0) {
+    return 0;
+  }
+  size_t n = steps + 1;
+
+  target.resize(steps);
+  natural.resize(steps);
+  lo.assign(n, -DBL_MAX);
+  hi.assign(n, DBL_MAX);
+  for (size_t i = 0; i < steps; ++i) {
+    MixStep const& s = mix.steps[i];
+    natural[i] = ToSemitones(s.track.bpm);
+    target[i] = natural[i] + s.GetTuning();
+
+    double limit = ToSemitones(1 + (stretch ? (*stretch)[i] : kMaxStretch));
+    lo[i]   = std::max(lo[i],   natural[i] - limit);
+    hi[i]   = std::min(hi[i],   natural[i] + limit);
+    lo[i+1] = std::max(lo[i+1], natural[i] - limit);
+    hi[i+1] = std::min(hi[i+1], natural[i] + limit);
+  }
+
+  // Neighbours too far apart to meet can only split the difference
+  for (size_t j = 0; j < n; ++j) {
+    if (lo[j] > hi[j]) {
+      lo[j] = hi[j] = (lo[j] + hi[j]) / 2;
+    }
+  }
+
+  // Active set: solve with the pinned hand-offs held at their bounds, then
+  // pin anything that came out of bounds and release anything the solution
+  // would rather pull back inside, until neither happens
+  // The system is an M-matrix, so this settles on the exact optimum, in
+  // practice within a few rounds whatever the length of the mix
+  // If it hasn't after kMaxTempoRounds, the last solve is clamped into the
+  // limits, which keeps it within them but no longer exactly optimal
+  x.resize(n);
+  scratch.resize(n);
+  std::vector<char> fixed(n, kFree);
+  std::vector<char> next(n);
+  bool settled = false;
+  for (size_t round = 0; round < kMaxTempoRounds; ++round) {
+    Build(fixed);
+    SolveTridiagonal(n, &a[0], &b[0], &c[0], &x[0], &scratch[0]);
+
+    // The gradient at a pinned bound is its multiplier, which has to point
+    // out of the box
+    for (size_t j = 0; j < n; ++j) {
+      next[j] = fixed[j];
+      if (fixed[j] == kFree) {
+        if (x[j] < lo[j]) {
+          next[j] = kAtLow;
+        } else if (x[j] > hi[j]) {
+          next[j] = kAtHigh;
+        }
+      } else if (lo[j] < hi[j]) {
+        double g = Gradient(j);
+        if ((fixed[j] == kAtLow && g < 0) || (fixed[j] == kAtHigh && g > 0)) {
+          next[j] = kFree;
+        }
+      }
+    }
+    if (next == fixed) {
+      settled = true;
+      break;
+    }
+
+    fixed.swap(next);
+    for (size_t j = 0; j < n; ++j) {
+      if (fixed[j] != kFree) {
+        x[j] = fixed[j] == kAtLow ? lo[j] : hi[j];
+      }
+    }
+  }
+
+  if (!settled) {
+    for (size_t j = 0; j < n; ++j) {
+      x[j] = std::min(std::max(x[j], lo[j]), hi[j]);
+    }
+  }
+
+  double residual = 0;
+  for (size_t i = 0; i < steps; ++i) {
+    MixStep& s = mix.steps[i];
+    s.bpm_beg = FromSemitones(x[i]);
+    s.bpm_end = FromSemitones(x[i+1]);
+    residual += fabs(x[i] - target[i]) + fabs(x[i+1] - target[i]);
+  }
+  return residual;
+}
@@ -0,0 +1,73 @@
+#ifndef TEMPO_H
+#define TEMPO_H
+
+#include <vector>
+
+#include "mix.h"
+
+// How far (as a fraction) we're willing to push a track from its natural tempo
+static const double kMaxStretch = 0.08;
+
+// How much we care about smooth ramps within a track, relative to tuning
+static const double kRampWeight = 0.25;
+
+// Active set rounds before we settle for the last solve, kept within limits
+static const size_t kMaxTempoRounds = 16;
+
+// Picks every step's start and end tempo for a whole mix at once
+// Playing a track faster or slower shifts its pitch, so the ideal tempo for a
+// track is the one whose pitch shift matches the tuning of its play key
+// Working in semitones, with x[j] the tempo at the hand-off into step j, we
+// minimize the squared tuning residual at both ends of every step plus a
+// penalty on ramps within a step, subject to each track's stretch limit
+// That's a tridiagonal convex problem: each round of the active set method
+// below is a linear time solve, and there are at most kMaxTempoRounds of them
+// (random mixes of up to 10k steps settle in 5 or fewer), so a plan is linear
+// time however long the mix
+class TempoPlanner
+{
+public:
+
+  // Sets bpm_beg and bpm_end for every step, and returns the remaining
+  // tuning (in semitones) summed over all the hand-offs
+  // stretch optionally gives a per-step limit, otherwise kMaxStretch is used
+  double Plan(Mix& mix, std::vector<double> const* stretch = nullptr);
+
+  // Solves a tridiagonal system in place (Thomas algorithm)
+  // a is the sub-diagonal, b the diagonal, c the super-diagonal and d the
+  // right hand side, which is overwritten with the solution
+  static void SolveTridiagonal(
+    size_t n,
+    double const* a,
+    double const* b,
+    double const* c,
+    double* d,
+    double* scratch
+    );
+
+protected:
+
+  // Where each hand-off stands in the active set
+  enum Bound
+  {
+    kFree,
+    kAtLow,
+    kAtHigh
+  };
+
+  void Build(std::vector<char> const& fixed);
+  double Gradient(size_t j) const;
+
+  // Reused between calls so planning many mixes doesn't allocate
+  std::vector<double> target;
+  std::vector<double> natural;
+  std::vector<double> lo;
+  std::vector<double> hi;
+  std::vector<double> a;
+  std::vector<double> b;
+  std::vector<double> c;
+  std::vector<double> x;
+  std::vector<double> scratch;
+};
+
+#endif
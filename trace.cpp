@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "trace.h"
+
+static const char kBinaryMagic[4] = { 'M', 'X', 'T', '1' };
+
+static double Now()
+{
+  using namespace std::chrono;
+  return duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool IsCSV(std::string const& path)
+{
+  return path.size() >= 4 && !path.compare(path.size() - 4, 4, ".csv");
+}
+
+ConvergenceTrace::ConvergenceTrace() : start(Now()), evaluations(0)
+{
+}
+
+void ConvergenceTrace::Start()
+{
+  start = Now();
+  evaluations = 0;
+  points.clear();
+}
+
+void ConvergenceTrace::Record(size_t length, double cost)
+{
+  TracePoint p = { Now() - start, evaluations, static_cast<unsigned int>(length), cost };
+  points.push_back(p);
+}
+
+TracePoints const& ConvergenceTrace::GetPoints() const
+{
+  return points;
+}
+
+bool ConvergenceTrace::Write(std::string const& path) const
+{
+  if (IsCSV(path)) {
+    std::ofstream ofs(path);
+    ofs.precision(17);
+    ofs << "time,evaluations,length,cost" << std::endl;
+    for (auto const& p : points) {
+      ofs << p.time << "," << p.evaluations << "," << p.length << "," << p.cost << std::endl;
+    }
+    return static_cast<bool>(ofs);
+  }
+
+  std::ofstream ofs(path, std::ios::binary);
+  unsigned long long count = points.size();
+  ofs.write(kBinaryMagic, sizeof(kBinaryMagic));
+  ofs.write(reinterpret_cast<char const*>(&count), sizeof(count));
+  for (auto const& p : points) {
+    ofs.write(reinterpret_cast<char const*>(&p.time), sizeof(p.time));
+    ofs.write(reinterpret_cast<char const*>(&p.evaluations), sizeof(p.evaluations));
+    ofs.write(reinterpret_cast<char const*>(&p.length), sizeof(p.length));
+    ofs.write(reinterpret_cast<char const*>(&p.cost), sizeof(p.cost));
+  }
+  return static_cast<bool>(ofs);
+}
+
+bool ConvergenceTrace::Read(std::string const& path)
+{
+  points.clear();
+
+  if (IsCSV(path)) {
+    std::ifstream ifs(path);
+    std::string line;
+    getline(ifs, line);
+    while (getline(ifs, line)) {
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::stringstream ss(line);
+      TracePoint p;
+      if (ss >> p.time >> p.evaluations >> p.length >> p.cost) {
+        points.push_back(p);
+      }
+    }
+    return !points.empty();
+  }
+
+  std::ifstream ifs(path, std::ios::binary);
+  char magic[sizeof(kBinaryMagic)];
+  unsigned long long count = 0;
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char*>(&count), sizeof(count));
+  if (!ifs || !std::equal(magic, magic + sizeof(magic), kBinaryMagic)) {
+    return false;
+  }
+  for (unsigned long long i = 0; i < count; ++i) {
+    TracePoint p;
+    ifs.read(reinterpret_cast<char*>(&p.time), sizeof(p.time));
+    ifs.read(reinterpret_cast<char*>(&p.evaluations), sizeof(p.evaluations));
+    ifs.read(reinterpret_cast<char*>(&p.length), sizeof(p.length));
+    ifs.read(reinterpret_cast<char*>(&p.cost), sizeof(p.cost));
+    if (!ifs) {
+      return false;
+    }
+    points.push_back(p);
+  }
+  return true;
+}
+
+static double Percentile(std::vector<double> values, double p)
+{
+  if (values.empty()) {
+    return NAN;
+  }
+  std::sort(values.begin(), values.end());
+  double pos = p * (values.size() - 1);
+  size_t lo = static_cast<size_t>(floor(pos));
+  size_t hi = std::min(lo + 1, values.size() - 1);
+  return values[lo] + (pos - lo) * (values[hi] - values[lo]);
+}
+
+bool TraceReport::Write(
+  std::string const& path,
+  std::vector<ConvergenceTrace> const& traces,
+  bool by_evaluations,
+  size_t num_points
+  )
+{
+  // The grid runs from the earliest to the latest improvement in any trace
+  double x_min = DBL_MAX;
+  double x_max = 0;
+  for (auto const& t : traces) {
+    for (auto const& p : t.GetPoints()) {
+      double x = by_evaluations ? static_cast<double>(p.evaluations) : p.time;
+      x_min = std::min(x_min, std::max(x, 1e-9));
+      x_max = std::max(x_max, x);
+    }
+  }
+  if (x_max <= 0 || num_points < 2) {
+    return false;
+  }
+
+  std::ofstream ofs(path);
+  ofs << (by_evaluations ? "evaluations" : "time")
+      << ",length_p10,length_p50,length_p90,cost_p10,cost_p50,cost_p90" << std::endl;
+
+  double ratio = pow(x_max / x_min, 1.0 / (num_points - 1));
+  double x = x_min;
+  for (size_t i = 0; i < num_points; ++i, x *= ratio) {
+    std::vector<double> lengths;
+    std::vector<double> costs;
+    for (auto const& t : traces) {
+      TracePoint const* best = nullptr;
+      for (auto const& p : t.GetPoints()) {
+        double px = by_evaluations ? static_cast<double>(p.evaluations) : p.time;
+        if (px > x * (1 + 1e-12)) {
+          break;
+        }
+        best = &p;
+      }
+
+      // Nothing found yet counts as an empty mix
+      lengths.push_back(best ? best->length : 0);
+      if (best) {
+        costs.push_back(best->cost);
+      }
+    }
+
+    ofs << x;
+    for (double p : { 0.1, 0.5, 0.9 }) {
+      ofs << "," << Percentile(lengths, p);
+    }
+    for (double p : { 0.1, 0.5, 0.9 }) {
+      ofs << "," << Percentile(costs, p);
+    }
+    ofs << std::endl;
+  }
+  return true;
+}
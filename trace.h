@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+
+struct TracePoint
+{
+  double             time;
+  unsigned long long evaluations;
+  unsigned int       length;
+  double             cost;
+};
+
+typedef std::vector<TracePoint> TracePoints;
+
+// Records how a solver's best mix improves over time and evaluations
+// Solvers count their evaluations as they go and only record a point when
+// they improve, so keeping a trace is cheap enough to leave on
+class ConvergenceTrace
+{
+public:
+
+  ConvergenceTrace();
+
+  // Resets the clock and the evaluation count
+  void Start();
+
+  void Count(unsigned long long evaluations)
+  {
+    this->evaluations += evaluations;
+  }
+
+  void Record(size_t length, double cost);
+
+  TracePoints const& GetPoints() const;
+
+  // Traces ending in .csv are text, anything else is packed binary
+  bool Write(std::string const& path) const;
+  bool Read(std::string const& path);
+
+protected:
+
+  double             start;
+  unsigned long long evaluations;
+  TracePoints        points;
+};
+
+// Summarizes a set of traces (e.g. the same solver over different seeds)
+// At each point on a log-spaced grid of time or evaluations, we take every
+// trace's best so far and report the 10th, 50th and 90th percentiles
+class TraceReport
+{
+public:
+
+  static bool Write(
+    std::string const& path,
+    std::vector<ConvergenceTrace> const& traces,
+    bool by_evaluations,
+    size_t num_points
+    );
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+using namespace std;
+
+// Aggregates convergence traces (e.g. one per seed) into percentile curves
+//
+// Usage: mixant_trace_report [--evaluations] [--points N] [--out report.csv] trace...
+//
+// By default the curves are against time; --evaluations plots them against
+// the number of candidates scanned instead, which doesn't depend on the machine
+
+int main(int argc, char* argv[])
+{
+  bool by_evaluations = false;
+  size_t num_points = 50;
+  string out_path = "trace_report.csv";
+  vector<string> paths;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--evaluations") {
+      by_evaluations = true;
+    } else if (arg == "--points" && i + 1 < argc) {
+      num_points = atoi(argv[++i]);
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  vector<ConvergenceTrace> traces;
+  for (auto const& p : paths) {
+    ConvergenceTrace t;
+    if (!t.Read(p)) {
+      cerr << "Couldn't read trace " << p << endl;
+      return EXIT_FAILURE;
+    }
+    traces.push_back(t);
+  }
+
+  if (!TraceReport::Write(out_path, traces, by_evaluations, num_points)) {
+    cerr << "Nothing to report" << endl;
+    return EXIT_FAILURE;
+  }
+  cout << "Wrote report on " << traces.size() << " traces to " << out_path << endl;
+  return EXIT_SUCCESS;
+}
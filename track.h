@@ -1,6 +1,7 @@
 #ifndef TRACK_H
 #define TRACK_H
 
+#include <cmath>
 #include <string>
 
 #include "key.h"
@@ -12,9 +13,14 @@ struct Track
   double bpm;
   Key key;
 
+  // Tempo on a log scale (in semitones), so tempo changes are differences
+  double log_bpm;
+
   //Track(std::string const& name, double bpm, Key const& key) : name(name), bpm(bpm), key(key) {}
-  Track(int idx, double bpm, Key const& key) : idx(idx), bpm(bpm), key(key) {}
+  Track(int idx, double bpm, Key const& key) : idx(idx), bpm(bpm), key(key), log_bpm(LogBPM(bpm)) {}
   bool operator==(Track const& t) const { return idx == t.idx; }
+
+  static double LogBPM(double bpm) { return 12 * log2(bpm); }
 };
 
 typedef std::vector<Track> Tracks;
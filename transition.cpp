@@ -0,0 +1,113 @@
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+#include "transition.h"
+
+// The largest shift that can ever be needed, since shifting by 12 is no shift
+static const int kMaxShift = 6;
+
+static int FindTranspose(
+  Key const& key_a,
+  Key const& key_b
+  )
+{
+  // How far must we transpose the "second" track to make it compatible with the "first"?
+  int min_transpose_dist = INT_MAX;
+  Keys compatible;
+  Key::GetCompatibleKeys(key_a, compatible);
+  for (auto k : compatible) {
+    // Only care about keys compatible with "first", and ones of the same type as our "second" track
+    if (k.type != key_b.type) {
+      continue;
+    }
+    int transpose_dist = Key::GetTransposeDistance(key_b, k);
+    if (abs(transpose_dist) < abs(min_transpose_dist)) {
+      min_transpose_dist = transpose_dist;
+    }
+  }
+  return min_transpose_dist;
+}
+
+static Key ChoosePlayKey(
+  Key const& prev_play,
+  Key const& natural
+  )
+{
+  // We're done if we're already compatible
+  if (Key::AreCompatibleKeys(natural, prev_play)) {
+    return natural;
+  }
+
+  // We're not compatible, so we need a tuning change in the current track
+  // Choose the key with the smallest combined distance between previous and next
+  Key play = natural;
+  int min_dist = INT_MAX;
+  Keys compatible_keys;
+  Key::GetCompatibleKeys(prev_play, compatible_keys);
+  for (auto k : compatible_keys) {
+
+    // Can't switch between min-maj!
+    // And we only care about compatible keys
+    if (k.type != natural.type) {
+      continue;
+    }
+
+    // Want the smallest distance between our natural key and the next one
+    int cur_dist = Key::GetTransposeDistance(natural, k);
+    // Check the total distance -- want the best value
+    if (abs(cur_dist) <= min_dist) {
+      min_dist = abs(cur_dist);
+      play = k;
+    }
+  }
+
+  return play;
+}
+
+static std::vector<Transition> MakeTransitions()
+{
+  Keys const& keys = Key::GetKeys();
+  std::vector<Transition> transitions(keys.size() * keys.size());
+  for (size_t a = 0; a < keys.size(); ++a) {
+    for (size_t b = 0; b < keys.size(); ++b) {
+      Transition& t = transitions[a * keys.size() + b];
+
+      Key play = ChoosePlayKey(keys[a], keys[b]);
+      t.play_key = static_cast<unsigned char>(Key::GetKeyIndex(play));
+      t.tuning = static_cast<signed char>(Key::GetTransposeDistance(keys[b], play));
+      t.transpose = static_cast<signed char>(FindTranspose(keys[a], keys[b]));
+      t.key_distance = static_cast<unsigned char>(Key::GetCamelotDistance(keys[a], keys[b]));
+
+      // Try shifting the next key by ever more, downwards first
+      for (int dist = 0; dist <= kMaxShift; ++dist) {
+        int shift = -dist;
+        if (!Key::AreCompatibleKeys(keys[a], keys[b] + shift)) {
+          shift = dist;
+        }
+        if (Key::AreCompatibleKeys(keys[a], keys[b] + shift)) {
+          t.shift = static_cast<signed char>(shift);
+          t.shift_key = static_cast<unsigned char>(Key::GetKeyIndex(keys[b] + shift));
+          break;
+        }
+      }
+    }
+  }
+  return transitions;
+}
+
+Transition const* TransitionTable::GetRow(int play_key)
+{
+  static std::vector<Transition> const transitions = MakeTransitions();
+  return transitions.data() + play_key * Key::GetKeys().size();
+}
+
+Transition const* TransitionTable::GetRow(Key const& play_key)
+{
+  return GetRow(Key::GetKeyIndex(play_key));
+}
+
+Transition const& TransitionTable::Get(Key const& play_key, Key const& natural)
+{
+  return GetRow(play_key)[Key::GetKeyIndex(natural)];
+}
@@ -0,0 +1,43 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include "key.h"
+
+// Everything about moving from one key to another that doesn't depend on tempo
+// Indexed by the key the previous track is playing in, then the next track's
+// natural key (both as Key::GetKeyIndex)
+struct Transition
+{
+  // Key index the next track should play in (as MixAnt::ChoosePlayKey), and
+  // how far that is from its natural key (as MixStep::GetTuning)
+  unsigned char play_key;
+  signed char   tuning;
+
+  // Smallest transposition of the next track that suits the previous key (as
+  // MixAnt::FindTranspose), which is what the transition is costed on
+  signed char   transpose;
+
+  // Camelot distance between the previous key and the next natural key
+  unsigned char key_distance;
+
+  // Smallest shift of the next track's key (negative first on ties) that
+  // makes it compatible, and the key index that shift lands on
+  signed char   shift;
+  unsigned char shift_key;
+};
+
+// The 24x24 table is built once, the first time anyone asks for it, so the
+// key searches behind each entry never happen while solving
+class TransitionTable
+{
+public:
+
+  // Row for a previous play key, indexed by the next track's natural key
+  // Rows are laid out one after another, so row 0 starts the whole table
+  static Transition const* GetRow(int play_key);
+  static Transition const* GetRow(Key const& play_key);
+
+  static Transition const& Get(Key const& play_key, Key const& natural);
+};
+
+#endif